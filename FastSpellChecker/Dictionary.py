@@ -1,11 +1,24 @@
-from ._backend import CPPDictionary
+from ._backend import CPPDictionary, Backend, Options, EditCosts, Normalization
 
 class Dictionary:
 
     def __init__(self,
                  file_or_wordlist = None,
                  normalize_fn = None,
-                 max_distance = 2):
+                 max_distance = 2,
+                 backend = Backend.HashTable,
+                 num_shards = 16,
+                 memory_budget = 0,
+                 transpositions = False,
+                 exact_count = False,
+                 edit_costs = None,
+                 utf8 = False,
+                 normalization = None,
+                 cache_capacity = 0,
+                 negative_cache_capacity = 0,
+                 latency_histograms = False,
+                 slow_query_ns = 0,
+                 on_slow_query = None):
         '''
         Create a new dictionary.
 
@@ -15,11 +28,51 @@ class Dictionary:
         :param file_or_wordlist (str): A list of strings or an opened file containing the words to insert
         :param normalize_fn (str): Function used to normalize words (e.g. lowercase conversion...)
         :max_distance (int): The maximum distance allowed when searching for candidates
+        :backend (Backend): The index layout (Backend.Sharded allows concurrent add_word and lookups, Backend.Trie
+                            is much smaller but slower and counts the edits in bytes, Backend.Auto chooses between
+                            Backend.HashTable and Backend.Trie at load from the words, max_distance and memory_budget,
+                            Backend.Frozen is Backend.HashTable stored in a perfect hash table at the end of the load:
+                            faster queries and a smaller index, but add_word raises after load)
+        :num_shards (int): The number of shards of the Backend.Sharded index
+        :memory_budget (int): Bytes the index must fit in (0: no budget). Backend.Auto picks Backend.Trie when the
+                              hash table would not fit, the longest words are then kept out of the index (checked
+                              by a scan, see downgraded_words) until it fits
+        :transpositions (bool): Count the swap of two adjacent characters as a single error
+        :exact_count (bool): best_match counts all the words at the best distance (otherwise the count is a lower
+                             bound, but the search is faster)
+        :edit_costs (EditCosts): Costs of the confusions used to rank the candidates (optional)
+        :utf8 (bool): Count the edits in characters instead of UTF-8 bytes (e.g. "é" vs "e" is 1 edit)
+        :normalization (Normalization): Native normalizations (e.g. Normalization.Lowercase | Normalization.StripAccents)
+                                        applied after normalize_fn. The matched word keeps its original spelling.
+                                        The words are read as UTF-8 (with or without utf8).
+        :cache_capacity (int): Number of query results kept in cache (0 disables the cache)
+        :negative_cache_capacity (int): Number of recent misses remembered to skip their search (0 disables it)
+        :latency_histograms (bool): Record the latency of the queries by distance and query length
+        :slow_query_ns (int): Latency (in ns) above which on_slow_query is called (0 disables it)
+        :on_slow_query (callable): Called with (word, d, kind, elapsed_ns, counters) for the slow queries, counters
+                                   being the work of the query (as last_query_counters(), zeros unless built with
+                                   FSC_QUERY_COUNTERS=1)
         '''
 
         if normalize_fn:
             self.normalize = normalize_fn
         self._max_distance = max_distance
+        self._options = Options()
+        self._options.backend = backend
+        self._options.num_shards = num_shards
+        self._options.max_distance = max_distance
+        self._options.memory_budget = memory_budget
+        self._options.transpositions = transpositions
+        self._options.exact_count = exact_count
+        self._options.edit_costs = edit_costs
+        self._options.utf8 = utf8
+        if normalization is not None:
+            self._options.normalization = normalization
+        self._options.cache_capacity = cache_capacity
+        self._options.negative_cache_capacity = negative_cache_capacity
+        self._options.latency_histograms = latency_histograms
+        self._options.slow_query_ns = slow_query_ns
+        self._options.on_slow_query = on_slow_query
 
         self.load(file_or_wordlist)
 
@@ -31,14 +84,34 @@ class Dictionary:
         Args
         ====
 
-        :param file_or_wordlist (str): A list of strings or an opened file containing the words to insert
+        :param file_or_wordlist (str): A list of strings or an opened file containing the words to insert. A numpy
+                                       array of strings (dtype 'S' or 'U') or a pair of Arrow-style buffers
+                                       (offsets, data) is read without creating a Python string per word (unless
+                                       a normalize_fn is set).
+        '''
+        self._impl = CPPDictionary(self._options)
+        if self._is_column(file_or_wordlist) and not self._has_normalize_fn():
+            self._impl.load_column(file_or_wordlist)
+        elif file_or_wordlist is not None:
+            # Loaded at once (not by add_word) for Backend.Auto, Backend.Frozen and the memory budget planning
+            words = [self.normalize(word.rstrip()) for word in file_or_wordlist]
+            self._impl.load(words)
+
+    def load_file(self, path: str, num_threads = 1):
+        '''
+        Initialize (or reset) the dictionary from a file of words (1 per line) read natively. The trailing whitespaces
+        are removed, the empty lines and the duplicates are skipped.
+
+        The normalize function is not applied (use the native normalization instead).
+
+        Args
+        ====
+
+        :param path (str): The path of the file
+        :param num_threads (int): Number of threads splitting the file (and inserting the words with Backend.Sharded)
         '''
-        self._impl = CPPDictionary()
-        if file_or_wordlist is not None:
-            for word in file_or_wordlist:
-                word = word.rstrip()
-                word = self.normalize(word)
-                self._impl.add_word(word)
+        self._impl = CPPDictionary(self._options)
+        self._impl.load_file(str(path), num_threads)
 
     def best_match(self, word: str, d = -1):
         '''
@@ -54,7 +127,9 @@ class Dictionary:
         :return: A dictionary with fields:
                  - word: (one of) the closest match in the dictionary
                  - distance: The distance with the closest match
-                 - count: The number of words matching with this distance in the dictionary
+                 - count: The number of words matching with this distance in the dictionary (a lower bound
+                          unless exact_count)
+                 - weighted_distance: The distance with the edit costs of the dictionary (= distance if none)
         '''
         if d > self._max_distance:
             raise ValueError("Distance ({}) exceeds the max distance capacity (){})".format(d, self._max_distance))
@@ -76,11 +151,138 @@ class Dictionary:
         d = d if d >= 0 else self._max_distance
         return self._impl.has_matches(word, d)
 
+    def has_matches_batch(self, words, d = -1):
+        '''
+        has_matches for a numpy array of strings (dtype 'S' or 'U') or a pair of Arrow-style buffers (offsets, data).
+        The normalize function is not applied (use the native normalization instead).
+
+        :return: A numpy array of booleans
+        '''
+        if d > self._max_distance:
+            raise ValueError("Distance ({}) exceeds the max distance capacity (){})".format(d, self._max_distance))
+        d = d if d >= 0 else self._max_distance
+        return self._impl.has_matches_batch(words, d)
+
+    def best_match_batch(self, words, d = -1):
+        '''
+        best_match for a numpy array of strings (dtype 'S' or 'U') or a pair of Arrow-style buffers (offsets, data).
+        The normalize function is not applied (use the native normalization instead).
+
+        :return: A list of matches (None if there is no match). Building one dict per word is the slow part of
+                 large batches: best_match_columns returns numpy arrays instead.
+        '''
+        if d > self._max_distance:
+            raise ValueError("Distance ({}) exceeds the max distance capacity (){})".format(d, self._max_distance))
+        d = d if d >= 0 else self._max_distance
+        return self._impl.best_match_batch(words, d)
+
+    def best_match_columns(self, words, d = -1):
+        '''
+        best_match for a batch of words (list of str, numpy array of strings or Arrow-style (offsets, data)) returned
+        as 3 numpy arrays (distance, count, word_id). Without a match within d, the distance and the word id are -1.
+        The matched words are fetched with word(id) or words(ids).
+        The normalize function is not applied (use the native normalization instead).
+        '''
+        if d > self._max_distance:
+            raise ValueError("Distance ({}) exceeds the max distance capacity (){})".format(d, self._max_distance))
+        d = d if d >= 0 else self._max_distance
+        return self._impl.best_match_columns(words, d)
+
+    def word(self, word_id: int):
+        '''
+        Return the word of an id (the words of the dictionary are numbered from 0 in insertion order)
+        '''
+        return self._impl.word(word_id)
+
+    def words(self, word_ids):
+        '''
+        Return the list of the words of an array of ids (None for -1)
+        '''
+        return self._impl.words(word_ids)
+
+    def correct_text(self, text: str, d = -1):
+        '''
+        Correct all the words of a text (numbers and punctuation are skipped).
+
+        The normalize function is not applied (use the native normalization instead).
+
+        :return: The list of corrections (start, end, word, distance) where text[start:end] should be replaced by word
+        '''
+        if d > self._max_distance:
+            raise ValueError("Distance ({}) exceeds the max distance capacity (){})".format(d, self._max_distance))
+        d = d if d >= 0 else self._max_distance
+        return self._impl.correct_text(text, d)
+
+    def segment(self, text: str, d = -1, budget = 2, chars_per_error = 4):
+        '''
+        Split a run-together token (e.g. "ruedupont") into words of the dictionary.
+
+        :param d (int): Maximum errors per word
+        :param budget (int): Maximum errors for the whole token
+        :param chars_per_error (int): A word has at most one error per chars_per_error characters (must be >= 1)
+        :return: The list of segments (start, end, word, distance) or None if there is no segmentation within budget
+        '''
+        if d > self._max_distance:
+            raise ValueError("Distance ({}) exceeds the max distance capacity (){})".format(d, self._max_distance))
+        d = d if d >= 0 else self._max_distance
+        return self._impl.segment(text, d, budget, chars_per_error)
+
+    def cache_stats(self):
+        '''
+        Return the statistics of the query cache (hits, misses, size, capacity)
+        '''
+        return self._impl.cache_stats()
+
+    def backend(self):
+        '''
+        Return the backend in use (the choice of Backend.Auto)
+        '''
+        return self._impl.backend()
+
+    def stats(self):
+        '''
+        Return the size and shape of the index: words, downgraded, keys, postings, buckets, load_factor, keys_by_length,
+        lists_by_log2_size (number of keys with 2^i <= postings < 2^(i+1)), longest_lists (key, postings) and the
+        estimated bytes by component (keys, postings, table, other, total)
+        '''
+        return self._impl.stats()
+
+    def downgraded_words(self):
+        '''
+        Return the words kept out of the index to fit in memory_budget (they are still found, by a scan)
+        '''
+        return self._impl.downgraded_words()
+
+    def latency_histogram(self, d, length_class):
+        '''
+        Return the latency percentiles (in ns) of the queries at distance d and of a class of length (see
+        FastSpellChecker._backend.length_class): count, p50, p90, p99, p999, max
+        '''
+        return self._impl.latency_histogram(d, length_class)
+
+    def reset_latency_histograms(self):
+        self._impl.reset_latency_histograms()
+
+    def negative_cache_stats(self):
+        '''
+        Return the statistics of the negative cache (hits, misses, size, capacity)
+        '''
+        return self._impl.negative_cache_stats()
+
     def candidates(self, word: str, d = -1):
         '''
         Return the list of candidate words in the dictionary at a given distances
+
+        :return: A list of dictionaries with fields word, distance and weighted_distance (the closest first)
         '''
-        raise NotImplementedError()
+        if d > self._max_distance:
+            raise ValueError("Distance ({}) exceeds the max distance capacity (){})".format(d, self._max_distance))
+        if len(word) > self._impl.max_word_length():
+            raise ValueError("The size (={}) of the string exceeds the maximim word length (={}).".format(len(word), self._impl.max_word_length()))
+
+        word = self.normalize(word)
+        d = d if d >= 0 else self._max_distance
+        return self._impl.candidates(word, d)
 
     def __contains__(self, word: str):
         '''
@@ -92,3 +294,13 @@ class Dictionary:
     @staticmethod
     def normalize(word):
         return word
+
+    def _has_normalize_fn(self):
+        return "normalize" in self.__dict__
+
+    @staticmethod
+    def _is_column(words):
+        if isinstance(words, tuple) and len(words) == 2:
+            return True
+        dtype = getattr(words, "dtype", None)
+        return dtype is not None and dtype.kind in "SU"
@@ -1,18 +1,339 @@
 #include <pybind11/pybind11.h>
+#include <pybind11/functional.h>
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 #include "fsc.hpp"
+#include "fsc_phrase.hpp"
+#include "fsc_segment.hpp"
+#include "fsc_text.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 
 namespace py = pybind11;
 
 
+namespace
+{
+  // Views on a column of strings read through the buffer protocol (no Python object per string). The UCS-4 strings
+  // of numpy 'U' arrays are transcoded to UTF-8 in `storage`. The buffer stays exported while the views are used
+  // without the GIL (the column is destroyed with the GIL held).
+  struct StringColumn
+  {
+    std::vector<std::string_view>  views;
+    std::string                    storage;
+    std::optional<py::buffer_info> buffer;
+  };
+
+  void append_utf8(char32_t c, std::string& out)
+  {
+    if (c < 0x80)
+      out.push_back((char)c);
+    else if (c < 0x800)
+    {
+      out.push_back((char)(0xC0 | (c >> 6)));
+      out.push_back((char)(0x80 | (c & 0x3F)));
+    }
+    else if (c < 0x10000)
+    {
+      out.push_back((char)(0xE0 | (c >> 12)));
+      out.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+      out.push_back((char)(0x80 | (c & 0x3F)));
+    }
+    else
+    {
+      out.push_back((char)(0xF0 | (c >> 18)));
+      out.push_back((char)(0x80 | ((c >> 12) & 0x3F)));
+      out.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+      out.push_back((char)(0x80 | (c & 0x3F)));
+    }
+  }
+
+  // Whether the items of a buffer format (struct module syntax) are in the byte order of the machine
+  bool is_native_order(const std::string& format)
+  {
+    const std::uint16_t one    = 1;
+    const bool          little = *reinterpret_cast<const char*>(&one) == 1;
+
+    char order = format.empty() ? '@' : format.front();
+    if (order == '<')
+      return little;
+    if (order == '>' || order == '!')
+      return !little;
+    return true;
+  }
+
+  char32_t byteswap(char32_t c)
+  {
+    return (c >> 24) | ((c >> 8) & 0xFF00) | ((c << 8) & 0xFF0000) | (c << 24);
+  }
+
+  // A 1D numpy array of fixed-width strings: 'S' (bytes) or 'U' (UCS-4, of any byte order). The trailing NULs are
+  // not part of the strings (as in numpy).
+  StringColumn from_numpy(const py::buffer& array)
+  {
+    auto info = array.request();
+    if (info.ndim != 1)
+      throw std::runtime_error("Expected a 1D array of strings");
+
+    char        kind   = info.format.empty() ? 0 : info.format.back();
+    std::size_t n      = info.shape[0];
+    auto        stride = info.strides[0];
+    auto        base   = static_cast<const char*>(info.ptr);
+
+    StringColumn column;
+    column.views.reserve(n);
+    if (kind == 's')
+    {
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        const char* s   = base + (py::ssize_t)i * stride;
+        std::size_t len = info.itemsize;
+        while (len > 0 && s[len - 1] == 0)
+          --len;
+        column.views.emplace_back(s, len);
+      }
+    }
+    else if (kind == 'w')
+    {
+      // Transcode everything first (the storage must not move once the views are taken)
+      bool                     swap = !is_native_order(info.format);
+      std::vector<std::size_t> ends(n);
+      column.storage.reserve(n * info.itemsize / 4);
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        auto        s   = reinterpret_cast<const char32_t*>(base + (py::ssize_t)i * stride);
+        std::size_t len = info.itemsize / 4;
+        while (len > 0 && s[len - 1] == 0)
+          --len;
+        for (std::size_t k = 0; k < len; ++k)
+          append_utf8(swap ? byteswap(s[k]) : s[k], column.storage);
+        ends[i] = column.storage.size();
+      }
+      for (std::size_t i = 0, start = 0; i < n; start = ends[i++])
+        column.views.emplace_back(column.storage.data() + start, ends[i] - start);
+    }
+    else
+      throw std::runtime_error("Expected an array of strings (numpy dtype 'S' or 'U')");
+    column.buffer = std::move(info);
+    return column;
+  }
+
+  // Arrow-style strings: the UTF-8 bytes of all the strings (contiguous data) and the n + 1 offsets of the strings in
+  // data (int32 or int64 in native byte order)
+  StringColumn from_arrow(const py::buffer& offsets, const py::buffer& data)
+  {
+    auto off = offsets.request();
+    auto buf = data.request();
+    if (off.ndim != 1 || buf.ndim != 1 || buf.itemsize != 1 || off.shape[0] < 1)
+      throw std::runtime_error("Expected 1D buffers of offsets (n + 1 integers) and data (bytes)");
+    if (off.itemsize != 4 && off.itemsize != 8)
+      throw std::runtime_error("The offsets must be int32 or int64");
+    if (!is_native_order(off.format))
+      throw std::runtime_error("The offsets must be in the native byte order");
+    if (buf.shape[0] > 1 && buf.strides[0] != 1)
+      throw std::runtime_error("The data must be contiguous");
+
+    auto offset_at = [&](std::size_t i) -> std::int64_t {
+      auto p = static_cast<const char*>(off.ptr) + (py::ssize_t)i * off.strides[0];
+      return off.itemsize == 4 ? *reinterpret_cast<const std::int32_t*>(p) : *reinterpret_cast<const std::int64_t*>(p);
+    };
+
+    std::size_t  n     = off.shape[0] - 1;
+    std::int64_t size  = buf.shape[0];
+    auto         chars = static_cast<const char*>(buf.ptr);
+
+    StringColumn column;
+    column.views.reserve(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      auto start = offset_at(i);
+      auto end   = offset_at(i + 1);
+      if (start < 0 || end < start || end > size)
+        throw std::runtime_error("Invalid offsets (must be increasing and within the data)");
+      column.views.emplace_back(chars + start, end - start);
+    }
+    column.buffer = std::move(buf);
+    return column;
+  }
+
+  // A list of str
+  StringColumn from_list(const py::list& words)
+  {
+    StringColumn             column;
+    std::vector<std::size_t> ends;
+    ends.reserve(words.size());
+    for (auto w : words)
+    {
+      column.storage += w.cast<std::string_view>();
+      ends.push_back(column.storage.size());
+    }
+    for (std::size_t i = 0, start = 0; i < ends.size(); start = ends[i++])
+      column.views.emplace_back(column.storage.data() + start, ends[i] - start);
+    return column;
+  }
+
+  // A numpy array of strings, a pair (offsets, data) or a list of str
+  StringColumn to_column(const py::object& words)
+  {
+    if (py::isinstance<py::list>(words))
+      return from_list(words.cast<py::list>());
+    if (py::isinstance<py::tuple>(words) && py::len(words) == 2)
+    {
+      auto t = words.cast<py::tuple>();
+      return from_arrow(t[0].cast<py::buffer>(), t[1].cast<py::buffer>());
+    }
+    return from_numpy(words.cast<py::buffer>());
+  }
+
+  // A dict (word, distance, count, weighted_distance), None if there is no match within d
+  py::object match_to_python(const DictionaryMatch& r, int d)
+  {
+    if (r.distance > d)
+      return py::none();
+
+    py::dict result;
+    result["word"]     = py::str(r.word);
+    result["distance"] = r.distance;
+    result["count"]    = r.count;
+    result["weighted_distance"] = r.weighted_distance;
+    return result;
+  }
+
+  py::dict counters_to_dict(const QueryCounters& c)
+  {
+    py::dict result;
+    result["queries"]        = c.queries;
+    result["variants"]       = c.variants;
+    result["key_hits"]       = c.key_hits;
+    result["postings"]       = c.postings;
+    result["distance_calls"] = c.distance_calls;
+    result["early_exits"]    = c.early_exits;
+    return result;
+  }
+
+  // DictionaryOptions::on_slow_query calling a Python callable with (word, d, kind, elapsed_ns, counters). It keeps
+  // the callable so that the property can return it; the queries may run without the GIL (batches).
+  struct SlowQueryHook
+  {
+    explicit SlowQueryHook(py::function f)
+      : fn(new py::function(std::move(f)), [](py::function* p) {
+        py::gil_scoped_acquire gil;
+        delete p;
+      })
+    {
+    }
+
+    void operator()(const SlowQuery& q) const
+    {
+      py::gil_scoped_acquire gil;
+      (*fn)(std::string(q.word), q.d, q.kind, q.elapsed_ns, counters_to_dict(q.counters));
+    }
+
+    std::shared_ptr<py::function> fn;
+  };
+}
+
+
 class CPPDictionary
 {
 public:
+  CPPDictionary() = default;
+
+  explicit CPPDictionary(const DictionaryOptions& options)
+    : m_handle(options)
+  {
+  }
+
   void load(std::vector<std::string_view> word_list)
   {
     m_handle.load(word_list.data(), word_list.size());
   }
 
+  void load_file(const std::string& path, int num_threads) { m_handle.load_file(path, num_threads); }
+
+  // Load a numpy array of strings or a pair of Arrow-style buffers (offsets, data)
+  void load_column(const py::object& words)
+  {
+    auto column = to_column(words);
+    m_handle.load(column.views.data(), column.views.size());
+  }
+
+  // The batches are looked up without the GIL, once the views on the strings are taken
+  py::array_t<bool> has_matches_batch(const py::object& words, int d)
+  {
+    auto              column = to_column(words);
+    py::array_t<bool> result(column.views.size());
+    auto              out = result.mutable_unchecked<1>();
+    {
+      py::gil_scoped_release nogil;
+      for (std::size_t i = 0; i < column.views.size(); ++i)
+        out(i) = m_handle.has_matches(column.views[i], d);
+    }
+    return result;
+  }
+
+  // One dict per word: best_match_columns is the fast path for large batches
+  py::list best_match_batch(const py::object& words, int d)
+  {
+    auto                         column = to_column(words);
+    std::vector<DictionaryMatch> matches(column.views.size());
+    {
+      py::gil_scoped_release nogil;
+      for (std::size_t i = 0; i < column.views.size(); ++i)
+        matches[i] = m_handle.best_match(column.views[i], d);
+    }
+
+    py::list result;
+    for (const auto& m : matches)
+      result.append(match_to_python(m, d));
+    return result;
+  }
+
+  // The best matches as 3 arrays: distance, count and word id (-1 and 0 count if there is no match within d). The
+  // words are fetched with word(id) or words(ids).
+  py::tuple best_match_columns(const py::object& words, int d)
+  {
+    auto                      column = to_column(words);
+    auto                      n      = (py::ssize_t)column.views.size();
+    py::array_t<std::int32_t> distance(n);
+    py::array_t<std::int32_t> count(n);
+    py::array_t<std::int64_t> word_id(n);
+
+    auto dist_out  = distance.mutable_unchecked<1>();
+    auto count_out = count.mutable_unchecked<1>();
+    auto id_out    = word_id.mutable_unchecked<1>();
+    {
+      py::gil_scoped_release nogil;
+      for (py::ssize_t i = 0; i < n; ++i)
+      {
+        auto r = m_handle.best_match(column.views[i], d);
+        bool found = r.distance <= d;
+        dist_out(i)  = found ? r.distance : -1;
+        count_out(i) = found ? r.count : 0;
+        id_out(i)    = found ? (std::int64_t)m_handle.word_id(r.word) : -1;
+      }
+    }
+    return py::make_tuple(distance, count, word_id);
+  }
+
+  std::size_t num_words() const { return m_handle.num_words(); }
+  DictionaryBackend backend() const { return m_handle.backend(); }
+  py::str     word(std::uint32_t id) const { return py::str(m_handle.word(id)); }
+
+  // The words of an array of ids (None for -1)
+  py::list words(py::array_t<std::int64_t, py::array::forcecast> ids) const
+  {
+    auto     in = ids.unchecked<1>();
+    py::list result;
+    for (py::ssize_t i = 0; i < in.shape(0); ++i)
+      result.append(in(i) < 0 ? py::object(py::none()) : py::object(py::str(m_handle.word((std::uint32_t)in(i)))));
+    return result;
+  }
+
   void add_word(std::string_view word)
   {
     m_handle.add_word(word);
@@ -20,21 +341,133 @@ public:
 
   int max_word_length() const { return m_handle.max_word_length(); }
 
+  std::vector<std::string> downgraded_words() const { return m_handle.downgraded_words(); }
+
+  py::dict cache_stats() const { return to_dict(m_handle.cache_stats()); }
+  py::dict negative_cache_stats() const { return to_dict(m_handle.negative_cache_stats()); }
+
+  py::dict stats() const
+  {
+    auto     s = m_handle.stats();
+    py::dict bytes;
+    bytes["keys"]     = s.key_bytes;
+    bytes["postings"] = s.posting_bytes;
+    bytes["table"]    = s.table_bytes;
+    bytes["other"]    = s.other_bytes;
+    bytes["total"]    = s.total_bytes();
+
+    py::dict result;
+    result["words"]              = s.words;
+    result["downgraded"]         = s.downgraded;
+    result["keys"]               = s.keys;
+    result["postings"]           = s.postings;
+    result["buckets"]            = s.buckets;
+    result["load_factor"]        = s.load_factor;
+    result["keys_by_length"]     = s.keys_by_length;
+    result["lists_by_log2_size"] = s.lists_by_log2_size;
+    result["longest_lists"]      = s.longest_lists;
+    result["bytes"]              = bytes;
+    return result;
+  }
+
+  py::dict latency_histogram(int d, int length_class) const
+  {
+    auto     h = m_handle.latency_histogram(d, length_class);
+    py::dict result;
+    result["count"] = h.count();
+    result["p50"]   = h.percentile(50);
+    result["p90"]   = h.percentile(90);
+    result["p99"]   = h.percentile(99);
+    result["p999"]  = h.percentile(99.9);
+    result["max"]   = h.percentile(100);
+    return result;
+  }
+
+  void reset_latency_histograms() { m_handle.reset_latency_histograms(); }
+
+  static py::dict to_dict(const CacheStats& s)
+  {
+    py::dict result;
+    result["hits"]     = s.hits;
+    result["misses"]   = s.misses;
+    result["size"]     = s.size;
+    result["capacity"] = s.capacity;
+    return result;
+  }
+
   bool has_matches(std::string_view word, int d) { return m_handle.has_matches(word, d); }
 
-  py::object best_match(std::string_view word, int d)
+  py::object best_match(std::string_view word, int d) { return match_to_python(m_handle.best_match(word, d), d); }
+
+  py::list candidates(std::string_view word, int d)
   {
-    auto r = m_handle.best_match(word, d);
-    if (r.distance > d)
+    py::list result;
+    for (const auto& r : m_handle.candidates(word, d))
+    {
+      py::dict m;
+      m["word"]              = py::str(r.word);
+      m["distance"]          = r.distance;
+      m["weighted_distance"] = r.weighted_distance;
+      result.append(m);
+    }
+    return result;
+  }
+
+  // Return the segments (start, end, word, distance) of a run-together token (offsets in characters) or None
+  py::object segment(std::string_view text, int d, int budget, int chars_per_error)
+  {
+    auto r = ::segment(m_handle, text, d, budget, chars_per_error);
+    if (r.segments.empty())
       return py::none();
 
-    py::dict result;
-    result["word"]     = py::str(r.word);
-    result["distance"] = r.distance;
-    result["count"]    = r.count;
+    py::list    result;
+    std::size_t byte_pos = 0;
+    std::size_t char_pos = 0;
+    for (const auto& s : r.segments)
+    {
+      auto start = char_pos;
+      for (; byte_pos < s.offset + s.length; ++byte_pos)
+        char_pos += ((unsigned char)text[byte_pos] & 0xC0) != 0x80;
+      result.append(py::make_tuple(start, char_pos, py::str(s.match.word), s.match.distance));
+    }
     return result;
   }
 
+  // Return the list of the corrections (start, end, word, distance) of the tokens of a text (offsets in characters)
+  py::list correct_text(std::string_view text, int d)
+  {
+    struct Output : TextCorrector::Output
+    {
+      std::string_view text;
+      int              d;
+      std::size_t      byte_pos = 0;
+      std::size_t      char_pos = 0;
+      py::list         result;
+
+      // Convert a byte offset into a code point offset (offsets are increasing)
+      std::size_t to_char(std::size_t offset)
+      {
+        for (; byte_pos < offset; ++byte_pos)
+          char_pos += ((unsigned char)text[byte_pos] & 0xC0) != 0x80;
+        return char_pos;
+      }
+
+      void on_token(const TextCorrection& c) override
+      {
+        if (c.match.distance == 0 || c.match.distance > d)
+          return;
+        auto start = to_char(c.offset);
+        auto end   = to_char(c.offset + c.token.size());
+        result.append(py::make_tuple(start, end, py::str(c.match.word), c.match.distance));
+      }
+    } out;
+
+    out.text = text;
+    out.d    = d;
+    ::correct_text(m_handle, text, d, out);
+    return out.result;
+  }
+
 private:
   Dictionary m_handle;
 };
@@ -51,13 +484,134 @@ PYBIND11_MODULE(_backend, m) {
            )docstring";
 
 
+  py::enum_<DictionaryBackend>(m, "Backend")
+    .value("HashTable", DictionaryBackend::HashTable)
+    .value("Sharded", DictionaryBackend::Sharded)
+    .value("Trie", DictionaryBackend::Trie)
+    .value("Auto", DictionaryBackend::Auto)
+    .value("Frozen", DictionaryBackend::Frozen)
+    ;
+
+  // Flags: py::arithmetic() gives no bitwise operators to a scoped enum, they are bound here (an int is accepted too)
+  py::enum_<Normalization>(m, "Normalization", py::arithmetic())
+    .value("NoNormalization", Normalization::None)
+    .value("Lowercase", Normalization::Lowercase)
+    .value("StripAccents", Normalization::StripAccents)
+    .value("Whitespace", Normalization::Whitespace)
+    .value("Hyphens", Normalization::Hyphens)
+    .value("All", Normalization::All)
+    .def("__or__", [](Normalization a, Normalization b) { return a | b; })
+    .def("__and__", [](Normalization a, Normalization b) { return a & b; })
+    ;
+  py::implicitly_convertible<int, Normalization>();
+
+  m.def("normalize", [](std::string_view word, Normalization flags, bool utf8) { return normalize(word, flags, utf8); },
+        py::arg("word"), py::arg("flags"), py::arg("utf8") = true);
+
+  // Query counters (only maintained when built with FSC_QUERY_COUNTERS=1)
+  m.def("length_class", &length_class);
+  m.def("query_counters_enabled", &query_counters_enabled);
+  m.def("last_query_counters", []() { return counters_to_dict(last_query_counters()); });
+  m.def("thread_query_counters", []() { return counters_to_dict(thread_query_counters()); });
+  m.def("reset_thread_query_counters", &reset_thread_query_counters);
+
+  py::class_<EditCosts, std::shared_ptr<EditCosts>>(m, "EditCosts")
+    .def(py::init<>())
+    .def("set_confusion", &EditCosts::set_confusion, py::arg("read"), py::arg("expected"), py::arg("cost"),
+         py::arg("symmetric") = true)
+    .def("load", [](EditCosts& self, const std::string& filename, bool symmetric) {
+        std::ifstream f(filename);
+        if (!f)
+          throw std::runtime_error("Unable to open " + filename);
+        self.load(f, symmetric);
+      }, py::arg("filename"), py::arg("symmetric") = true)
+    .def("weighted_distance", &EditCosts::weighted_distance, py::arg("query"), py::arg("word"),
+         py::arg("max_cost") = 1e9f)
+    ;
+
+  // Python strings reach the library as UTF-8: the normalizations decode it even when the edits count bytes
+  py::class_<DictionaryOptions>(m, "Options")
+    .def(py::init([]() {
+      DictionaryOptions options;
+      options.utf8_normalization = true;
+      return options;
+    }))
+    .def_readwrite("backend", &DictionaryOptions::backend)
+    .def_readwrite("num_shards", &DictionaryOptions::num_shards)
+    .def_readwrite("max_distance", &DictionaryOptions::max_distance)
+    .def_readwrite("memory_budget", &DictionaryOptions::memory_budget)
+    .def_readwrite("transpositions", &DictionaryOptions::transpositions)
+    .def_readwrite("exact_count", &DictionaryOptions::exact_count)
+    .def_readwrite("utf8", &DictionaryOptions::utf8)
+    .def_readwrite("utf8_normalization", &DictionaryOptions::utf8_normalization)
+    .def_readwrite("normalization", &DictionaryOptions::normalization)
+    .def_readwrite("cache_capacity", &DictionaryOptions::cache_capacity)
+    .def_readwrite("negative_cache_capacity", &DictionaryOptions::negative_cache_capacity)
+    .def_readwrite("latency_histograms", &DictionaryOptions::latency_histograms)
+    .def_readwrite("slow_query_ns", &DictionaryOptions::slow_query_ns)
+    .def_property("on_slow_query",
+                  [](const DictionaryOptions& o) -> py::object {
+                    if (auto hook = o.on_slow_query.target<SlowQueryHook>())
+                      return *hook->fn;
+                    return py::none();
+                  },
+                  [](DictionaryOptions& o, std::optional<py::function> f) {
+                    if (!f)
+                      o.on_slow_query = nullptr;
+                    else
+                      o.on_slow_query = SlowQueryHook(std::move(*f));
+                  })
+    .def_property("edit_costs",
+                  [](const DictionaryOptions& o) { return std::const_pointer_cast<EditCosts>(o.edit_costs); },
+                  [](DictionaryOptions& o, std::shared_ptr<EditCosts> c) { o.edit_costs = std::move(c); })
+    ;
+
   py::class_<CPPDictionary>(m, "CPPDictionary")
     .def(py::init<>())
+    .def(py::init<const DictionaryOptions&>())
     .def("load", &CPPDictionary::load)
+    .def("load_column", &CPPDictionary::load_column)
+    .def("load_file", &CPPDictionary::load_file, py::call_guard<py::gil_scoped_release>())
+    .def("has_matches_batch", &CPPDictionary::has_matches_batch)
+    .def("best_match_batch", &CPPDictionary::best_match_batch)
+    .def("best_match_columns", &CPPDictionary::best_match_columns)
+    .def("num_words", &CPPDictionary::num_words)
+    .def("backend", &CPPDictionary::backend)
+    .def("word", &CPPDictionary::word)
+    .def("words", &CPPDictionary::words)
     .def("has_matches", &CPPDictionary::has_matches)
     .def("best_match", &CPPDictionary::best_match)
     .def("add_word", &CPPDictionary::add_word)
+    .def("correct_text", &CPPDictionary::correct_text)
     .def("max_word_length", &CPPDictionary::max_word_length)
+    .def("candidates", &CPPDictionary::candidates)
+    .def("segment", &CPPDictionary::segment)
+    .def("cache_stats", &CPPDictionary::cache_stats)
+    .def("negative_cache_stats", &CPPDictionary::negative_cache_stats)
+    .def("stats", &CPPDictionary::stats)
+    .def("downgraded_words", &CPPDictionary::downgraded_words)
+    .def("latency_histogram", &CPPDictionary::latency_histogram)
+    .def("reset_latency_histograms", &CPPDictionary::reset_latency_histograms)
+    ;
+
+  py::class_<PhraseMatcher>(m, "PhraseMatcher")
+    .def(py::init<>())
+    .def(py::init<const DictionaryOptions&>())
+    .def("load", [](PhraseMatcher& self, std::vector<std::string_view> phrases) {
+        self.load(phrases.data(), phrases.size());
+      })
+    .def("add_phrase", &PhraseMatcher::add_phrase)
+    .def("best_match", [](PhraseMatcher& self, std::string_view phrase, int d, int max_distance) -> py::object {
+        auto r = self.best_match(phrase, d, max_distance);
+        if (r.word == nullptr)
+          return py::none();
+
+        py::dict result;
+        result["word"]     = py::str(r.word);
+        result["distance"] = r.distance;
+        result["count"]    = r.count;
+        return result;
+      }, py::arg("phrase"), py::arg("d") = 1, py::arg("max_distance") = 2)
     ;
 
 #ifdef VERSION_INFO
@@ -1,3 +1,4 @@
 from .Dictionary import Dictionary
+from ._backend import Backend, EditCosts, Normalization, PhraseMatcher, normalize
 
-__all__ = [ "Dictionary" ]
+__all__ = [ "Dictionary", "Backend", "EditCosts", "Normalization", "PhraseMatcher", "normalize" ]
@@ -0,0 +1,267 @@
+#include <fsc.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+extern std::string_view test_data[];
+extern std::size_t      test_data_size;
+
+
+// Count the live heap bytes to report the size of an index (bytes/word)
+namespace
+{
+  std::atomic<std::size_t> g_live_bytes = 0;
+  constexpr std::size_t    kHeader     = alignof(std::max_align_t);
+}
+
+void* operator new(std::size_t size)
+{
+  auto p = static_cast<char*>(std::malloc(size + kHeader));
+  if (p == nullptr)
+    throw std::bad_alloc();
+  *reinterpret_cast<std::size_t*>(p) = size;
+  g_live_bytes.fetch_add(size, std::memory_order_relaxed);
+  return p + kHeader;
+}
+
+void operator delete(void* ptr) noexcept
+{
+  if (ptr == nullptr)
+    return;
+  auto p = static_cast<char*>(ptr) - kHeader;
+  g_live_bytes.fetch_sub(*reinterpret_cast<std::size_t*>(p), std::memory_order_relaxed);
+  std::free(p);
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void  operator delete[](void* ptr) noexcept { operator delete(ptr); }
+void  operator delete(void* ptr, std::size_t) noexcept { operator delete(ptr); }
+void  operator delete[](void* ptr, std::size_t) noexcept { operator delete(ptr); }
+
+
+namespace
+{
+  enum QuerySet
+  {
+    kHitShort,
+    kHitLong,
+    kMissShort,
+    kMissLong,
+  };
+
+  constexpr int kShortLength = 8;  // Short words have less than 8 chars
+  constexpr int kLongLength  = 16; // Long words have at least 16 chars
+
+  // Random lowercase words of 4 to 12 letters
+  std::vector<std::string> make_words(std::size_t n, unsigned seed)
+  {
+    std::mt19937                       gen(seed);
+    std::uniform_int_distribution<int> length(4, 12);
+    std::uniform_int_distribution<int> letter('a', 'z');
+
+    std::vector<std::string> words(n);
+    for (auto& w : words)
+    {
+      w.resize(length(gen));
+      for (auto& c : w)
+        c = (char)letter(gen);
+    }
+    return words;
+  }
+
+  // A word with d substitutions (a hit at distance d) or with only uppercase letters (a miss, the dictionaries are
+  // lowercase)
+  std::string make_query(std::string_view word, int d, bool hit, std::mt19937& gen)
+  {
+    std::string q(word);
+    if (!hit)
+    {
+      for (auto& c : q)
+        c = (char)('A' + gen() % 26);
+      return q;
+    }
+    for (int k = 0; k < d && k < (int)q.size(); ++k)
+    {
+      auto& c = q[(k * q.size()) / d];
+      c       = (c == 'x') ? 'y' : 'x';
+    }
+    return q;
+  }
+
+  std::vector<std::string> make_queries(const std::vector<std::string_view>& words, int d, int set)
+  {
+    std::mt19937             gen(42);
+    std::vector<std::string> queries;
+    for (auto w : words)
+    {
+      bool is_short = (int)w.size() < kShortLength;
+      bool is_long  = (int)w.size() >= kLongLength;
+      bool keep     = (set == kHitShort || set == kMissShort) ? is_short : is_long;
+      if (keep)
+        queries.push_back(make_query(w, d, set == kHitShort || set == kHitLong, gen));
+    }
+    return queries;
+  }
+
+  const char* query_set_name(int set)
+  {
+    static const char* names[] = {"hit/short", "hit/long", "miss/short", "miss/long"};
+    return names[set];
+  }
+
+  const char* backend_name(int backend)
+  {
+    static const char* names[] = {"hash", "sharded", "trie", "auto", "frozen"};
+    return names[backend];
+  }
+
+  DictionaryOptions backend_options(int backend)
+  {
+    DictionaryOptions opts;
+    opts.backend = (DictionaryBackend)backend;
+    return opts;
+  }
+
+
+  struct Corpus
+  {
+    std::vector<std::string>      storage;
+    std::vector<std::string_view> words;
+    std::unique_ptr<Dictionary>   dict;
+  };
+
+  // The dictionaries are built once and shared by the benchmarks (n = 0 is the test data)
+  Corpus& corpus(std::size_t n, int backend = 0)
+  {
+    static std::map<std::pair<std::size_t, int>, Corpus> corpora;
+
+    auto& c = corpora[{n, backend}];
+    if (c.dict)
+      return c;
+
+    if (n == 0)
+      c.words.assign(test_data, test_data + test_data_size);
+    else
+    {
+      c.storage = make_words(n, 1234);
+      c.words.assign(c.storage.begin(), c.storage.end());
+    }
+    c.dict = std::make_unique<Dictionary>(backend_options(backend));
+    c.dict->load(c.words.data(), c.words.size());
+    return c;
+  }
+
+  void load(benchmark::State& state, std::vector<std::string_view>& words, int backend)
+  {
+    std::size_t bytes = 0;
+    state.SetLabel(backend_name(backend));
+    for (auto _ : state)
+    {
+      auto before = g_live_bytes.load();
+      auto d      = std::make_unique<Dictionary>(backend_options(backend));
+      d->load(words.data(), words.size());
+      bytes = g_live_bytes.load() - before;
+
+      state.PauseTiming();
+      d.reset();
+      state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * words.size());
+    state.counters["bytes/word"] = (double)bytes / words.size();
+  }
+
+  template <class F>
+  void query(benchmark::State& state, Dictionary& dict, const std::vector<std::string>& queries, F&& f)
+  {
+    if (queries.empty())
+    {
+      state.SkipWithError("no query");
+      return;
+    }
+
+    std::size_t i = 0;
+    for (auto _ : state)
+    {
+      benchmark::DoNotOptimize(f(dict, queries[i]));
+      if (++i == queries.size())
+        i = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["ns/query"] =
+      benchmark::Counter((double)state.iterations(), benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+  }
+}
+
+
+// Args: backend
+static void BM_load_test_data(benchmark::State& state)
+{
+  std::vector<std::string_view> words(test_data, test_data + test_data_size);
+  load(state, words, (int)state.range(0));
+}
+BENCHMARK(BM_load_test_data)->DenseRange(0, 2)->Arg(4)->Unit(benchmark::kMillisecond);
+
+// Args: number of words, backend
+static void BM_load_synthetic(benchmark::State& state)
+{
+  auto                          storage = make_words(state.range(0), 1234);
+  std::vector<std::string_view> words(storage.begin(), storage.end());
+  load(state, words, (int)state.range(1));
+}
+BENCHMARK(BM_load_synthetic)
+  ->ArgsProduct({{10'000, 100'000, 1'000'000}, {0, 2, 4}})
+  ->Unit(benchmark::kMillisecond);
+
+
+// Args: max distance, query set, backend
+static void BM_best_match(benchmark::State& state)
+{
+  int   d       = (int)state.range(0);
+  int   set     = (int)state.range(1);
+  auto& c       = corpus(0, (int)state.range(2));
+  auto  queries = make_queries(c.words, d, set);
+
+  state.SetLabel(std::string(query_set_name(set)) + "/" + backend_name((int)state.range(2)));
+  query(state, *c.dict, queries, [d](Dictionary& dict, const std::string& q) { return dict.best_match(q, d); });
+}
+BENCHMARK(BM_best_match)->ArgsProduct({{0, 1, 2}, {kHitShort, kHitLong, kMissShort, kMissLong}, {0, 2, 4}});
+
+static void BM_has_matches(benchmark::State& state)
+{
+  int   d       = (int)state.range(0);
+  int   set     = (int)state.range(1);
+  auto& c       = corpus(0, (int)state.range(2));
+  auto  queries = make_queries(c.words, d, set);
+
+  state.SetLabel(std::string(query_set_name(set)) + "/" + backend_name((int)state.range(2)));
+  query(state, *c.dict, queries, [d](Dictionary& dict, const std::string& q) { return dict.has_matches(q, d); });
+}
+BENCHMARK(BM_has_matches)->ArgsProduct({{0, 1, 2}, {kHitShort, kHitLong, kMissShort, kMissLong}, {0, 2, 4}});
+
+
+// Args: dictionary size, max distance (hits on any word length), backend
+static void BM_best_match_synthetic(benchmark::State& state)
+{
+  int   d = (int)state.range(1);
+  auto& c = corpus(state.range(0), (int)state.range(2));
+
+  std::mt19937             gen(42);
+  std::vector<std::string> queries;
+  for (std::size_t i = 0; i < c.words.size(); i += c.words.size() / 1000)
+    queries.push_back(make_query(c.words[i], d, true, gen));
+
+  state.SetLabel(backend_name((int)state.range(2)));
+  query(state, *c.dict, queries, [d](Dictionary& dict, const std::string& q) { return dict.best_match(q, d); });
+}
+BENCHMARK(BM_best_match_synthetic)->ArgsProduct({{10'000, 100'000, 1'000'000}, {1, 2}, {0, 4}});
+
+
+BENCHMARK_MAIN();
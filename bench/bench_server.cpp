@@ -0,0 +1,108 @@
+// Loopback benchmark of the correction server: a client sends batches of queries on a Unix domain socket to a
+// server running in the same process.
+#include <fsc_service.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+extern std::string_view test_data[];
+extern std::size_t      test_data_size;
+
+
+namespace
+{
+  struct Service
+  {
+    Service()
+      : path((std::filesystem::temp_directory_path() / ("fsc_bench_" + std::to_string(::getpid()) + ".sock")).string())
+    {
+      dict.load(test_data, test_data_size);
+      server = std::make_unique<CorrectionServer>(dict, path);
+      thread = std::thread([this] { server->run(); });
+    }
+
+    ~Service()
+    {
+      server->stop();
+      thread.join();
+    }
+
+    std::string                       path;
+    Dictionary                        dict;
+    std::unique_ptr<CorrectionServer> server;
+    std::thread                       thread;
+  };
+
+  Service& service()
+  {
+    static Service s;
+    return s;
+  }
+
+  // Test words with one substitution
+  std::vector<std::string> make_queries(std::size_t n)
+  {
+    std::mt19937             gen(42);
+    std::vector<std::string> queries(n);
+    for (auto& q : queries)
+    {
+      q.assign(test_data[gen() % test_data_size]);
+      if (!q.empty())
+        q[gen() % q.size()] = 'x';
+    }
+    return queries;
+  }
+}
+
+
+// Args: batch size, number of batches in flight (pipelining)
+static void BM_server_best_match(benchmark::State& state)
+{
+  std::size_t batch_size = state.range(0);
+  int         depth      = (int)state.range(1);
+
+  auto                          storage = make_queries(batch_size);
+  std::vector<std::string_view> batch(storage.begin(), storage.end());
+  CorrectionClient              client(service().path);
+
+  for (auto _ : state)
+  {
+    for (int k = 0; k < depth; ++k)
+      client.send(CorrectionClient::kBestMatch, batch, 1);
+    for (int k = 0; k < depth; ++k)
+      benchmark::DoNotOptimize(client.receive());
+  }
+  state.SetItemsProcessed(state.iterations() * batch_size * depth);
+  state.counters["ns/query"] = benchmark::Counter((double)state.iterations() * batch_size * depth,
+                                                  benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+BENCHMARK(BM_server_best_match)->ArgsProduct({{1, 16, 256}, {1, 8}})->UseRealTime();
+
+// The same queries without the server
+static void BM_local_best_match(benchmark::State& state)
+{
+  auto  queries = make_queries(256);
+  auto& dict    = service().dict;
+
+  std::size_t i = 0;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(dict.best_match(queries[i], 1));
+    if (++i == queries.size())
+      i = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["ns/query"] =
+    benchmark::Counter((double)state.iterations(), benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+BENCHMARK(BM_local_best_match);
+
+
+BENCHMARK_MAIN();
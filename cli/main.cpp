@@ -0,0 +1,377 @@
+// fsc: correct the tokens of text files (or of stdin) with a word list
+//
+// The tokens are the whitespace-separated words of the input. Each token gives one line of output, in the order of
+// the input, with its best match at a distance <= d (TSV or JSON lines). The tokens are corrected by batches, each
+// split between the threads.
+#include <fsc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+  const char* kUsage = R"(usage: fsc -w WORD_FILE [options] [FILE...]
+
+Correct the whitespace-separated tokens of the files (or of stdin, also read for "-").
+
+options:
+  -w, --words FILE      Word list, one word per line (required)
+  -d, --distance N      Max edit distance (default 2)
+  -j, --threads N       Number of threads (default: number of cores)
+  -f, --format FORMAT   tsv (token, word, distance, count) or json (one object per line)
+  -m, --misspelled      Only output the tokens that are not in the dictionary
+  -b, --batch N         Number of tokens corrected at a time (default 65536)
+  --lowercase           Ignore the ASCII case
+  --strip-accents       Ignore the diacritics of the Latin letters
+  --utf8                Count the edits in UTF-8 characters
+  --transpositions      Count a swap of adjacent characters as 1 edit
+  --stats               Print the load time and the throughput on stderr
+)";
+
+  struct Options
+  {
+    std::string              words;
+    int                      d           = 2;
+    int                      num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    bool                     json        = false;
+    bool                     misspelled  = false;
+    std::size_t              batch_size  = 1 << 16;
+    bool                     stats       = false;
+    DictionaryOptions        dict;
+    std::vector<std::string> inputs;
+  };
+
+  [[noreturn]] void usage_error(const std::string& message)
+  {
+    std::cerr << "fsc: " << message << "\n\n" << kUsage;
+    std::exit(2);
+  }
+
+  int to_int(const char* s, const char* name)
+  {
+    char* end;
+    long  v = std::strtol(s, &end, 10);
+    if (*s == '\0' || *end != '\0' || v < 0 || v > 1'000'000'000)
+      usage_error(std::string("invalid ") + name + ": " + s);
+    return (int)v;
+  }
+
+  Options parse(int argc, char** argv)
+  {
+    Options opts;
+    for (int i = 1; i < argc; ++i)
+    {
+      std::string_view a = argv[i];
+
+      // Short options also take their value attached (-d1)
+      const char* attached = nullptr;
+      if (a.size() > 2 && a[0] == '-' && a[1] != '-' && std::string_view("wdjfb").find(a[1]) != std::string_view::npos)
+      {
+        attached = argv[i] + 2;
+        a        = a.substr(0, 2);
+      }
+
+      auto value = [&]() -> const char* {
+        if (attached != nullptr)
+          return attached;
+        if (i + 1 == argc)
+          usage_error(std::string("missing value of ") + argv[i]);
+        return argv[++i];
+      };
+
+      if (a == "-h" || a == "--help")
+      {
+        std::cout << kUsage;
+        std::exit(0);
+      }
+      else if (a == "-w" || a == "--words")
+        opts.words = value();
+      else if (a == "-d" || a == "--distance")
+        opts.d = to_int(value(), "distance");
+      else if (a == "-j" || a == "--threads")
+        opts.num_threads = std::max(1, to_int(value(), "number of threads"));
+      else if (a == "-f" || a == "--format")
+      {
+        std::string_view f = value();
+        if (f != "tsv" && f != "json")
+          usage_error("unknown format: " + std::string(f));
+        opts.json = (f == "json");
+      }
+      else if (a == "-m" || a == "--misspelled")
+        opts.misspelled = true;
+      else if (a == "-b" || a == "--batch")
+        opts.batch_size = std::max(1, to_int(value(), "batch size"));
+      else if (a == "--lowercase")
+        opts.dict.normalization = opts.dict.normalization | Normalization::Lowercase;
+      else if (a == "--strip-accents")
+        opts.dict.normalization = opts.dict.normalization | Normalization::StripAccents;
+      else if (a == "--utf8")
+        opts.dict.utf8 = true;
+      else if (a == "--transpositions")
+        opts.dict.transpositions = true;
+      else if (a == "--stats")
+        opts.stats = true;
+      else if (a.size() > 1 && a[0] == '-')
+        usage_error("unknown option: " + std::string(a));
+      else
+        opts.inputs.emplace_back(a);
+    }
+    if (opts.words.empty())
+      usage_error("no word list (-w)");
+    if (opts.d < 0 || opts.d > 2)
+      usage_error("invalid distance: " + std::to_string(opts.d) + " (must be 0, 1 or 2)");
+    if (opts.inputs.empty())
+      opts.inputs.emplace_back("-");
+    return opts;
+  }
+
+
+  // Length of the valid UTF-8 sequence at s[i] (0 if invalid: overlong, surrogate, cut or beyond U+10FFFF)
+  int utf8_length(std::string_view s, std::size_t i)
+  {
+    auto     x = (unsigned char)s[i];
+    int      len;
+    char32_t min;
+    if (x >= 0xC2 && x <= 0xDF)
+      len = 2, min = 0x80;
+    else if (x >= 0xE0 && x <= 0xEF)
+      len = 3, min = 0x800;
+    else if (x >= 0xF0 && x <= 0xF4)
+      len = 4, min = 0x10000;
+    else
+      return 0;
+    if (s.size() - i < (std::size_t)len)
+      return 0;
+
+    char32_t c = x & (0x7F >> len);
+    for (int k = 1; k < len; ++k)
+    {
+      auto y = (unsigned char)s[i + k];
+      if ((y & 0xC0) != 0x80)
+        return 0;
+      c = (c << 6) | (y & 0x3F);
+    }
+    if (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+      return 0;
+    return len;
+  }
+
+  // The bytes that are not valid UTF-8 (e.g. Latin-1 words) are escaped as the code points of the same value
+  void append_json_string(std::string& out, std::string_view s)
+  {
+    static const char hex[] = "0123456789abcdef";
+    auto escape = [&](unsigned char c) {
+      out += "\\u00";
+      out += hex[c >> 4];
+      out += hex[c & 15];
+    };
+
+    out += '"';
+    for (std::size_t i = 0; i < s.size(); ++i)
+    {
+      auto c = (unsigned char)s[i];
+      if (c == '"' || c == '\\')
+      {
+        out += '\\';
+        out += (char)c;
+      }
+      else if (c < 0x20)
+        escape(c);
+      else if (c < 0x80)
+        out += (char)c;
+      else if (int len = utf8_length(s, i))
+      {
+        out.append(s.data() + i, len);
+        i += len - 1;
+      }
+      else
+        escape(c);
+    }
+    out += '"';
+  }
+
+  void format(std::string& out, std::string_view token, const DictionaryMatch& m, int d, bool json)
+  {
+    bool found = m.distance <= d && m.word != nullptr;
+    if (json)
+    {
+      out += "{\"token\":";
+      append_json_string(out, token);
+      if (found)
+      {
+        out += ",\"word\":";
+        append_json_string(out, m.word);
+        out += ",\"distance\":" + std::to_string(m.distance) + ",\"count\":" + std::to_string(m.count) + "}\n";
+      }
+      else
+        out += ",\"word\":null,\"distance\":null,\"count\":0}\n";
+      return;
+    }
+
+    out += token;
+    out += '\t';
+    if (found)
+    {
+      out += m.word;
+      out += '\t' + std::to_string(m.distance) + '\t' + std::to_string(m.count) + '\n';
+    }
+    else
+      out += "\t-1\t0\n";
+  }
+
+
+  // Tokens of the current batch, corrected by the threads into their own output buffer
+  class Corrector
+  {
+  public:
+    Corrector(Dictionary& dict, const Options& opts)
+      : m_dict(dict)
+      , m_opts(opts)
+      , m_outputs(opts.num_threads)
+    {
+    }
+
+    void add(std::string_view token)
+    {
+      m_ends.push_back(m_text.size() + token.size());
+      m_text += token;
+      if (m_ends.size() == m_opts.batch_size)
+        flush();
+    }
+
+    void flush()
+    {
+      std::size_t n = m_ends.size();
+      if (n == 0)
+        return;
+      m_count += n;
+
+      int num_threads = (int)std::min<std::size_t>(m_opts.num_threads, (n + 1023) / 1024);
+      if (num_threads <= 1)
+        correct(0, n, m_outputs[0]);
+      else
+      {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t)
+          threads.emplace_back(&Corrector::correct, this, n * t / num_threads, n * (t + 1) / num_threads,
+                               std::ref(m_outputs[t]));
+        for (auto& t : threads)
+          t.join();
+      }
+
+      for (int t = 0; t < std::max(num_threads, 1); ++t)
+        std::fwrite(m_outputs[t].data(), 1, m_outputs[t].size(), stdout);
+      m_text.clear();
+      m_ends.clear();
+    }
+
+    std::size_t count() const { return m_count; }
+
+  private:
+    void correct(std::size_t first, std::size_t last, std::string& out)
+    {
+      out.clear();
+      for (std::size_t i = first; i < last; ++i)
+      {
+        std::size_t      begin = (i == 0) ? 0 : m_ends[i - 1];
+        std::string_view token(m_text.data() + begin, m_ends[i] - begin);
+        if ((int)token.size() > m_dict.max_word_length()) // Not in the dictionary, no match
+        {
+          format(out, token, {nullptr, m_opts.d + 1, 0, 0}, m_opts.d, m_opts.json);
+          continue;
+        }
+        auto m = m_dict.best_match(token, m_opts.d);
+        if (!m_opts.misspelled || m.distance != 0)
+          format(out, token, m, m_opts.d, m_opts.json);
+      }
+    }
+
+    Dictionary&              m_dict;
+    const Options&           m_opts;
+    std::string              m_text; // The tokens of the batch (contiguous)
+    std::vector<std::size_t> m_ends; // End of each token in m_text
+    std::vector<std::string> m_outputs;
+    std::size_t              m_count = 0;
+  };
+
+
+  void read_tokens(std::istream& in, Corrector& corrector)
+  {
+    auto is_space = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f'; };
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+      std::size_t i = 0;
+      while (i < line.size())
+      {
+        while (i < line.size() && is_space(line[i]))
+          ++i;
+        std::size_t begin = i;
+        while (i < line.size() && !is_space(line[i]))
+          ++i;
+        if (i > begin)
+          corrector.add(std::string_view(line).substr(begin, i - begin));
+      }
+    }
+  }
+}
+
+
+int main(int argc, char** argv)
+{
+  auto opts = parse(argc, argv);
+  std::ios::sync_with_stdio(false);
+
+  using clock = std::chrono::steady_clock;
+  try
+  {
+    auto       start = clock::now();
+    Dictionary dict(opts.dict);
+    dict.load_file(opts.words, opts.num_threads);
+    auto loaded = clock::now();
+
+    Corrector corrector(dict, opts);
+    for (const auto& path : opts.inputs)
+    {
+      if (path == "-")
+      {
+        read_tokens(std::cin, corrector);
+        continue;
+      }
+      std::ifstream in(path, std::ios::binary);
+      if (!in)
+        throw std::runtime_error("Failed to open " + path);
+      read_tokens(in, corrector);
+    }
+    corrector.flush();
+    std::fflush(stdout);
+
+    if (opts.stats)
+    {
+      auto   end           = clock::now();
+      double load_seconds  = std::chrono::duration<double>(loaded - start).count();
+      double query_seconds = std::chrono::duration<double>(end - loaded).count();
+      std::cerr << "words:  " << dict.num_words() << " loaded in " << load_seconds << " s\n"
+                << "tokens: " << corrector.count() << " in " << query_seconds << " s ("
+                << (query_seconds > 0 ? corrector.count() / query_seconds : 0) << " tokens/s, " << opts.num_threads
+                << " threads)\n";
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "fsc: " << e.what() << '\n';
+    return 1;
+  }
+  return 0;
+}
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 #include <iosfwd>
 
 
@@ -9,7 +14,8 @@ struct DictionaryMatch
 {
   const char* word; // One a the best match
   int         distance;
-  int         count;
+  int         count;    // Number of words at this distance (a lower bound unless DictionaryOptions::exact_count)
+  float       weighted_distance; // Distance with the edit costs of the dictionary (= distance if none)
 
 
   operator bool() const;
@@ -19,21 +25,253 @@ std::ostream& operator<< (std::ostream& os, const DictionaryMatch& m);
 
 
 
+/// Edit distance between two words (<= 255 bytes): Levenshtein, or optimal string alignment if transpositions is
+/// set, counted in bytes or in UTF-8 characters.
+int edit_distance(std::string_view a, std::string_view b, bool transpositions = false, bool utf8 = false);
+
+
+/// Costs of the edit operations used to rank the candidates. By default, any insertion, deletion or substitution
+/// costs 1; confusions (e.g. "rn" read for "m" by an OCR) can be made cheaper or more expensive.
+class EditCosts
+{
+public:
+  static constexpr int kMaxConfusionLength = 4;
+
+  EditCosts();
+
+  /// Set the cost of reading `read` (in the query) instead of `expected` (in the dictionary). One of them can be
+  /// empty to set the cost of an insertion/deletion.
+  void  set_confusion(std::string_view read, std::string_view expected, float cost, bool symmetric = true);
+
+  /// Read a confusion table with one "read<TAB>expected<TAB>cost" entry per line ('#' starts a comment)
+  void  load(std::istream& is, bool symmetric = true);
+
+  /// Weighted distance between `query` and `word`. Any value > max_cost means "more than max_cost".
+  float weighted_distance(std::string_view query, std::string_view word, float max_cost) const;
+
+private:
+  struct confusion_t
+  {
+    std::string read;
+    std::string expected;
+    float       cost;
+  };
+
+  float                    m_subst[256][256];
+  float                    m_delete[256];
+  float                    m_insert[256];
+  std::vector<confusion_t> m_confusions; // Multi-character confusions
+};
+
+
+/// Normalizations applied to the words at load and query time (can be combined with |)
+enum class Normalization : unsigned
+{
+  None         = 0,
+  Lowercase    = 1, // ASCII case folding
+  StripAccents = 2, // Remove the diacritics of the Latin letters (Latin-1 or UTF-8)
+  Whitespace   = 4, // Collapse the blanks into a single space and trim
+  Hyphens      = 8, // Read '-' and '_' as spaces
+  All          = 15,
+};
+
+constexpr Normalization operator|(Normalization a, Normalization b)
+{
+  return Normalization((unsigned)a | (unsigned)b);
+}
+
+constexpr Normalization operator&(Normalization a, Normalization b)
+{
+  return Normalization((unsigned)a & (unsigned)b);
+}
+
+constexpr bool any(Normalization a)
+{
+  return a != Normalization::None;
+}
+
+/// Normalize a word into `out` (with room for word.size() chars), returns the normalized length (<= word.size())
+std::size_t normalize(std::string_view word, char out[], Normalization flags, bool utf8 = false);
+std::string normalize(std::string_view word, Normalization flags, bool utf8 = false);
+
+
+struct CacheStats
+{
+  std::uint64_t hits;
+  std::uint64_t misses;
+  std::size_t   size;     // Number of cached results
+  std::size_t   capacity; // Max number of cached results
+};
+
+
+// Work done by the searches of a query. The counters are only maintained when the library is built with
+// FSC_QUERY_COUNTERS (otherwise they stay at 0 and cost nothing).
+struct QueryCounters
+{
+  std::uint64_t queries;        // Number of queries (best_match, has_matches, candidates)
+  std::uint64_t variants;       // Deletion variants of the query probed in the index
+  std::uint64_t key_hits;       // Variants found in the index
+  std::uint64_t postings;       // Postings scanned
+  std::uint64_t distance_calls; // Distances computed from the deletion positions (levenshtein_of)
+  std::uint64_t early_exits;    // Branches cut by the bound on the distance (or by the first match in has_matches)
+
+  QueryCounters& operator+=(const QueryCounters& other);
+};
+
+bool          query_counters_enabled() noexcept;
+QueryCounters last_query_counters() noexcept;   // Counters of the last query of the calling thread
+QueryCounters thread_query_counters() noexcept; // Counters of the calling thread since the last reset
+void          reset_thread_query_counters() noexcept;
+
+
+// Latency distribution of queries (HDR-style buckets: 8 linear sub-buckets per power of 2, i.e. <= 12.5% error)
+struct LatencyHistogram
+{
+  static constexpr int kNumBuckets = 496;
+
+  std::vector<std::uint64_t> counts; // [b] = number of queries in bucket b (empty if not recorded)
+
+  std::uint64_t count() const;
+  std::uint64_t percentile(double p) const; // Upper bound (in ns) of the p-th percentile (p in [0, 100])
+
+  static int           bucket_of(std::uint64_t ns);
+  static std::uint64_t bucket_upper_bound(int b); // Largest latency (in ns) of the bucket
+};
+
+// The queries are recorded by distance and by class of query length (in bytes): < 4, < 8, < 16, < 32, >= 32
+constexpr int kNumLengthClasses = 5;
+int           length_class(std::size_t n);
+
+// Passed to the slow query hook
+struct SlowQuery
+{
+  std::string_view word;       // The query (as given)
+  int              d;          // Its max distance
+  const char*      kind;       // "best_match", "has_matches" or "candidates"
+  std::uint64_t    elapsed_ns;
+  QueryCounters    counters;   // Work done by the query (0 if not built with FSC_QUERY_COUNTERS)
+};
+
+
+// Size and shape of the deletion index (for the Trie backend: words, keys = trie nodes and the memory only)
+struct IndexStats
+{
+  std::size_t words;        // Number of words in the index (postings at distance 0)
+  std::size_t downgraded;   // Number of words kept out of the index by the memory budget
+  std::size_t keys;         // Number of distinct deletion keys
+  std::size_t postings;     // Number of (key, word) postings
+  std::size_t buckets;      // Number of hash table buckets (all shards)
+  double      load_factor;  // keys / buckets
+
+  std::vector<std::size_t> keys_by_length;    // [l] = number of keys of l bytes
+  std::vector<std::size_t> lists_by_log2_size; // [i] = number of keys with 2^i <= postings < 2^(i+1)
+
+  // The keys with the longest posting lists (the longest first)
+  static constexpr int kNumLongestLists = 10;
+  std::vector<std::pair<std::string, std::size_t>> longest_lists;
+
+  // Estimated memory (in bytes) by component
+  std::size_t key_bytes;     // Key strings and their storage
+  std::size_t posting_bytes; // Posting lists
+  std::size_t table_bytes;   // Hash table buckets and nodes
+  std::size_t other_bytes;   // Original spellings of the normalized words, downgraded words
+  std::size_t total_bytes() const { return key_bytes + posting_bytes + table_bytes + other_bytes; }
+};
+
+
+enum class DictionaryBackend
+{
+  HashTable, // Single hash table of deletions (concurrent reads only)
+  Sharded,   // Deletions partitioned in shards with a reader-writer lock each (concurrent reads and writes)
+  Trie,      // Words in a compact trie, an order of magnitude smaller but slower queries (no utf8, concurrent reads)
+  Auto,      // HashTable or Trie, chosen by load from the words, max_distance and memory_budget (see backend())
+  Frozen,    // HashTable frozen by load in a minimal perfect hash table: faster lookups, but no add_word after load
+};
+
+
+struct DictionaryOptions
+{
+  DictionaryBackend backend        = DictionaryBackend::HashTable;
+  int               num_shards     = 16;    // Number of shards (Sharded backend only)
+  int               max_distance   = 2;     // Largest distance of the queries (a hint for the Auto backend)
+
+  // Estimated bytes of index not to exceed (0: no budget). The Auto backend picks a backend that fits. Otherwise,
+  // the longest words (the most expensive to index) are kept out of the index and compared to each query of a
+  // compatible length instead (see Dictionary::downgraded_words).
+  std::size_t       memory_budget  = 0;
+  bool              transpositions = false; // Count a swap of adjacent characters as 1 edit (OSA distance)
+  bool              exact_count    = false; // best_match counts all the words at the best distance (slower)
+  bool              utf8           = false; // Edit UTF-8 code points instead of bytes
+  Normalization     normalization  = Normalization::None; // The matched word keeps its original spelling
+
+  // The normalizations read the words as UTF-8 (not Latin-1) even when the edits are counted in bytes (implied by
+  // utf8). Set by the Python binding, whose strings are UTF-8.
+  bool              utf8_normalization = false;
+  std::size_t       cache_capacity = 0; // Number of query results kept in cache (0 disables the cache)
+
+  // Number of recent misses (no word at a distance <= d) remembered to answer them without a search (0 disables
+  // the negative cache). When enabled, best_match does not report the matches farther than d.
+  std::size_t       negative_cache_capacity = 0;
+
+  std::shared_ptr<const EditCosts> edit_costs; // Rank the best match candidates with these costs (optional)
+
+  // Instrumentation (no timing at all if both are disabled)
+  bool                                  latency_histograms = false; // Record the latency of the queries
+  std::uint64_t                         slow_query_ns      = 0;     // Call on_slow_query above this latency
+  std::function<void(const SlowQuery&)> on_slow_query;              // Called in the querying thread
+};
+
+
+
 class Dictionary
 {
 public:
   Dictionary();
+  explicit Dictionary(const DictionaryOptions& options);
   ~Dictionary();
 
   void              load(std::string_view word_list[], std::size_t n);
+
+  /// Load a file of words (one per line, trailing whitespaces removed, empty lines and duplicates skipped). The
+  /// file is split by `num_threads` threads, and the Sharded backend also inserts the words concurrently (the word
+  /// ids and the spelling kept among the normalized duplicates are then in no particular order).
+  void              load_file(const std::string& path, int num_threads = 1);
+
+  /// Add a word to the current index. It never chooses the backend (Auto stays HashTable without a load) nor plans
+  /// the memory budget by length (the words are kept out of the index one by one once the budget is reached): load
+  /// the word list at once for that.
   void              add_word(std::string_view word);
   bool              has_matches(std::string_view word, int d);
   DictionaryMatch   best_match(std::string_view word, int d);
 
+  /// All the words at a distance <= d (count = 1), the closest first
+  std::vector<DictionaryMatch> candidates(std::string_view word, int d);
+
   int               max_word_length() const noexcept;
+  int               longest_word_length() const noexcept; // Length of the longest word of the dictionary
+
+  /// The distinct words of the dictionary are numbered in insertion order (from 0, reset by load)
+  static constexpr std::uint32_t kNoWord = UINT32_MAX;
+  std::size_t       num_words() const;
+  std::uint32_t     word_id(const char* word) const; // Id of a word returned by a match (kNoWord if none)
+  const char*       word(std::uint32_t id) const;
+  CacheStats        cache_stats() const;
+  CacheStats        negative_cache_stats() const;
+  IndexStats        stats() const; // Walk the whole index (not meant for the query path)
+  DictionaryBackend backend() const noexcept; // The backend in use (HashTable until the first load with Auto)
+  std::vector<std::string> downgraded_words() const; // The words kept out of the index by the memory budget
+
+  /// Latency of the queries at distance d and of a class of length (see length_class)
+  LatencyHistogram  latency_histogram(int d, int length_class) const;
+  void              reset_latency_histograms();
 
   struct DictionaryImplBase;
 private:
+  void create_impl(DictionaryBackend backend);
+  void select_backend(const std::string_view word_list[], std::size_t n);
+
+  DictionaryOptions                   m_options;
+  DictionaryBackend                   m_backend; // The one in use (the choice of Auto)
   std::unique_ptr<DictionaryImplBase> m_impl;
 };
 
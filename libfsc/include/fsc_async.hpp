@@ -0,0 +1,63 @@
+#pragma once
+
+#include <fsc.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+struct AsyncOptions
+{
+  int         num_threads    = 0;    // Number of worker threads (0: one per hardware thread)
+  std::size_t queue_capacity = 1024; // Max number of queued queries (not yet started)
+};
+
+
+/// Runs the queries of a dictionary on a pool of worker threads.
+///
+/// The queue is bounded: the submit functions block while it is full (backpressure), the try_ functions return
+/// std::nullopt instead. The errors of a query (e.g. a word too long) are reported by its future. The dictionary
+/// must outlive this object, and must not be loaded while queries are running (add_word is fine with the Sharded
+/// backend).
+class AsyncDictionary
+{
+public:
+  explicit AsyncDictionary(Dictionary& dict, const AsyncOptions& options = AsyncOptions{});
+  ~AsyncDictionary(); // Runs the queued queries and joins the workers
+
+  AsyncDictionary(const AsyncDictionary&)            = delete;
+  AsyncDictionary& operator=(const AsyncDictionary&) = delete;
+
+  std::future<DictionaryMatch>              best_match(std::string_view word, int d);
+  std::future<bool>                         has_matches(std::string_view word, int d);
+  std::future<std::vector<DictionaryMatch>> candidates(std::string_view word, int d);
+
+  std::optional<std::future<DictionaryMatch>> try_best_match(std::string_view word, int d);
+  std::optional<std::future<bool>>            try_has_matches(std::string_view word, int d);
+
+  std::size_t queue_size() const;
+
+private:
+  template <class R, class F>
+  std::optional<std::future<R>> submit(std::string_view word, int d, F query, bool wait);
+
+  // Queue a task, waiting for a free slot if `wait`. Returns false if the queue is full.
+  bool push(std::packaged_task<void()>& task, bool wait);
+  void run();
+
+  Dictionary&                            m_dict;
+  std::size_t                            m_capacity;
+  mutable std::mutex                     m_mutex;
+  std::condition_variable                m_not_empty;
+  std::condition_variable                m_not_full;
+  std::deque<std::packaged_task<void()>> m_queue;
+  bool                                   m_stopping = false;
+  std::vector<std::thread>               m_workers;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <fsc.hpp>
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+/// Dictionary of multi-word entries (e.g. street names) indexed by token.
+///
+/// The tokens of the entries (and the concatenations of two adjacent tokens, to catch the words merged by an OCR)
+/// are indexed in a deletion dictionary. A query is split into tokens, each token (and each pair of adjacent
+/// tokens, to catch the split words) is looked up and the entries sharing a token are scored by aligning their
+/// tokens with the query tokens:
+/// * a matched token costs its edit distance
+/// * two merged/split tokens cost their edit distance + 1 (the space)
+/// * a missing/extra token costs its length + 1
+class PhraseMatcher
+{
+public:
+  /// The phrases are added one by one: the Frozen backend is rejected
+  explicit PhraseMatcher(const DictionaryOptions& options = DictionaryOptions{});
+
+  void load(std::string_view phrases[], std::size_t n);
+  void add_phrase(std::string_view phrase);
+
+  /// Best entry for a phrase. `d` is the max distance of a token lookup (<= 2), `max_distance` the max score of
+  /// the whole phrase. Returns a match with word == nullptr if no entry scores <= max_distance.
+  DictionaryMatch best_match(std::string_view phrase, int d, int max_distance);
+
+private:
+  struct posting_t
+  {
+    int phrase;   // Index of the entry
+    int position; // Index of the first token in the entry
+  };
+
+  struct phrase_t
+  {
+    std::string              original;
+    std::vector<std::string> tokens;
+    std::vector<std::string> pairs; // Concatenations of the adjacent tokens
+  };
+
+  std::vector<std::string> tokenize(std::string_view phrase) const;
+  int                      distance(std::string_view a, std::string_view b) const;
+  int                      score(const std::vector<std::string>& query, const std::vector<std::string>& query_pairs,
+                                 const phrase_t& entry) const;
+  void                     add_token(std::string token, posting_t p);
+
+  DictionaryOptions                                            m_options;
+  Dictionary                                                   m_tokens;
+  std::deque<std::string>                                      m_token_words;
+  std::unordered_map<std::string_view, std::vector<posting_t>> m_postings;
+  std::deque<phrase_t>                                         m_phrases;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <fsc.hpp>
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+
+struct Segment
+{
+  std::size_t     offset; // Offset (in bytes) of the segment in the text
+  std::size_t     length; // Length (in bytes) of the segment
+  DictionaryMatch match;  // Best match of the segment
+};
+
+struct Segmentation
+{
+  std::vector<Segment> segments; // Empty if there is no segmentation within the budget
+  int                  distance; // Sum of the distances of the segments
+};
+
+
+/// Split a run-together token (e.g. "ruedupont") into words of the dictionary.
+///
+/// The segmentation minimizes the sum of the distances of the segments (then the number of segments). A segment
+/// matches a word at a distance <= d, with at most one error per `chars_per_error` characters (short segments are
+/// exact), and the total distance is limited to `budget`. Each substring is looked up at most once (dynamic
+/// programming over the split points), segments are not longer than the longest word of the dictionary + d.
+/// Throws std::invalid_argument if chars_per_error < 1.
+Segmentation segment(Dictionary& dict, std::string_view text, int d, int budget, int chars_per_error = 4);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <fsc.hpp>
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+
+struct TextCorrection
+{
+  std::size_t      offset; // Offset (in bytes) of the token from the beginning of the text
+  std::string_view token;  // The token as read in the text (only valid during the callback)
+  DictionaryMatch  match;  // Best match of the token (match.distance > d if none)
+};
+
+
+/// Tokenize a text and look up each word token in a dictionary.
+///
+/// Tokens are the runs of ASCII letters, digits and non-ASCII letters (UTF-8, or Latin-1 bytes), '-' joins two runs
+/// ("saint-martin"). The UTF-8 punctuation («, ’, …, no-break spaces) separates the tokens like the ASCII one.
+/// Tokens with a digit (numbers, "2e") and tokens exceeding the max word length are skipped.
+///
+/// The text can be given by chunks: a token cut at the end of a chunk is completed with the next one.
+class TextCorrector
+{
+public:
+  struct Output
+  {
+    virtual ~Output() = default;
+    virtual void on_token(const TextCorrection& c) = 0;
+  };
+
+  TextCorrector(Dictionary& dict, int d);
+
+  void feed(std::string_view chunk, Output& out);
+  void finish(Output& out);
+
+private:
+  // Process the tokens of text (starting at m_offset in the stream), returns the size of the processed prefix
+  std::size_t process(std::string_view text, bool last, Output& out);
+
+  Dictionary& m_dict;
+  int         m_max_distance;
+  std::size_t m_offset        = 0;     // Offset of the pending part in the stream
+  std::string m_pending;               // Unterminated token of the previous chunk
+  std::size_t m_scanned       = 0;     // Bytes of m_pending already scanned (the scan resumes there)
+  bool        m_scanned_digit = false; // Whether the scanned bytes have a digit
+};
+
+
+void correct_text(Dictionary& dict, std::string_view text, int d, TextCorrector::Output& out);
@@ -0,0 +1,112 @@
+#include <fsc_async.hpp>
+
+#include <algorithm>
+#include <string>
+
+
+AsyncDictionary::AsyncDictionary(Dictionary& dict, const AsyncOptions& options)
+  : m_dict{dict}
+  , m_capacity{std::max<std::size_t>(options.queue_capacity, 1)}
+{
+  int n = options.num_threads > 0 ? options.num_threads : (int)std::thread::hardware_concurrency();
+  n     = std::max(n, 1);
+
+  m_workers.reserve(n);
+  for (int i = 0; i < n; ++i)
+    m_workers.emplace_back([this] { this->run(); });
+}
+
+AsyncDictionary::~AsyncDictionary()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_not_empty.notify_all();
+  for (auto& t : m_workers)
+    t.join();
+}
+
+void AsyncDictionary::run()
+{
+  for (;;)
+  {
+    std::packaged_task<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_not_empty.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+      if (m_queue.empty())
+        return;
+      task = std::move(m_queue.front());
+      m_queue.pop_front();
+    }
+    m_not_full.notify_one();
+    task(); // The exceptions are stored in the future
+  }
+}
+
+bool AsyncDictionary::push(std::packaged_task<void()>& task, bool wait)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (wait)
+      m_not_full.wait(lock, [this] { return m_queue.size() < m_capacity; });
+    else if (m_queue.size() >= m_capacity)
+      return false;
+    m_queue.push_back(std::move(task));
+  }
+  m_not_empty.notify_one();
+  return true;
+}
+
+std::size_t AsyncDictionary::queue_size() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_queue.size();
+}
+
+
+// Queue a query (the word is copied, the caller's buffer may not outlive the query)
+template <class R, class F>
+std::optional<std::future<R>> AsyncDictionary::submit(std::string_view word, int d, F query, bool wait)
+{
+  std::packaged_task<R()> task([this, w = std::string(word), d, query] { return query(m_dict, w, d); });
+  auto                    result = task.get_future();
+  std::packaged_task<void()> t(std::move(task));
+  if (!push(t, wait))
+    return std::nullopt;
+  return result;
+}
+
+namespace
+{
+  auto kBestMatch  = [](Dictionary& dict, const std::string& w, int d) { return dict.best_match(w, d); };
+  auto kHasMatches = [](Dictionary& dict, const std::string& w, int d) { return dict.has_matches(w, d); };
+  auto kCandidates = [](Dictionary& dict, const std::string& w, int d) { return dict.candidates(w, d); };
+}
+
+
+std::future<DictionaryMatch> AsyncDictionary::best_match(std::string_view word, int d)
+{
+  return *submit<DictionaryMatch>(word, d, kBestMatch, true);
+}
+
+std::future<bool> AsyncDictionary::has_matches(std::string_view word, int d)
+{
+  return *submit<bool>(word, d, kHasMatches, true);
+}
+
+std::future<std::vector<DictionaryMatch>> AsyncDictionary::candidates(std::string_view word, int d)
+{
+  return *submit<std::vector<DictionaryMatch>>(word, d, kCandidates, true);
+}
+
+std::optional<std::future<DictionaryMatch>> AsyncDictionary::try_best_match(std::string_view word, int d)
+{
+  return submit<DictionaryMatch>(word, d, kBestMatch, false);
+}
+
+std::optional<std::future<bool>> AsyncDictionary::try_has_matches(std::string_view word, int d)
+{
+  return submit<bool>(word, d, kHasMatches, false);
+}
@@ -0,0 +1,160 @@
+#include <fsc.hpp>
+
+#include <algorithm>
+#include <istream>
+#include <stdexcept>
+#include <string>
+
+
+namespace
+{
+  constexpr int kMaxWordLength = 255;
+}
+
+
+EditCosts::EditCosts()
+{
+  for (int a = 0; a < 256; ++a)
+  {
+    for (int b = 0; b < 256; ++b)
+      m_subst[a][b] = (a == b) ? 0.f : 1.f;
+    m_delete[a] = 1.f;
+    m_insert[a] = 1.f;
+  }
+}
+
+
+void EditCosts::set_confusion(std::string_view read, std::string_view expected, float cost, bool symmetric)
+{
+  if (read.size() > kMaxConfusionLength || expected.size() > kMaxConfusionLength)
+    throw std::runtime_error("Confusion too long (should be <= 4)");
+  if (read.empty() && expected.empty())
+    throw std::runtime_error("Invalid empty confusion");
+  if (!(cost >= 0.f))
+    throw std::runtime_error("Invalid confusion cost (Must be >= 0)");
+
+  if (read.size() == 1 && expected.size() == 1)
+    m_subst[(unsigned char)read[0]][(unsigned char)expected[0]] = cost;
+  else if (read.size() == 1 && expected.empty())
+    m_delete[(unsigned char)read[0]] = cost;
+  else if (read.empty() && expected.size() == 1)
+    m_insert[(unsigned char)expected[0]] = cost;
+  else
+  {
+    auto it = std::find_if(m_confusions.begin(), m_confusions.end(),
+                           [&](const confusion_t& c) { return c.read == read && c.expected == expected; });
+    if (it != m_confusions.end())
+      it->cost = cost;
+    else
+      m_confusions.push_back({std::string(read), std::string(expected), cost});
+  }
+
+  if (symmetric && read != expected)
+    set_confusion(expected, read, cost, false);
+}
+
+
+void EditCosts::load(std::istream& is, bool symmetric)
+{
+  std::string line;
+  int         lineno = 0;
+  while (std::getline(is, line))
+  {
+    ++lineno;
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    auto p1 = line.find('\t');
+    auto p2 = (p1 == std::string::npos) ? p1 : line.find('\t', p1 + 1);
+    if (p2 == std::string::npos)
+      throw std::runtime_error("Invalid confusion table at line " + std::to_string(lineno));
+
+    float cost;
+    try
+    {
+      cost = std::stof(line.substr(p2 + 1));
+    }
+    catch (const std::exception&)
+    {
+      throw std::runtime_error("Invalid confusion cost at line " + std::to_string(lineno));
+    }
+
+    std::string_view l = line;
+    this->set_confusion(l.substr(0, p1), l.substr(p1 + 1, p2 - p1 - 1), cost, symmetric);
+  }
+}
+
+
+float EditCosts::weighted_distance(std::string_view query, std::string_view word, float max_cost) const
+{
+  // Weighted Levenshtein with multi-character confusions. A confusion needs to look back up to
+  // kMaxConfusionLength rows, so we keep a ring of kMaxConfusionLength + 1 rows.
+  constexpr int kRows = kMaxConfusionLength + 1;
+
+  int n = std::min<int>(query.size(), kMaxWordLength);
+  int m = std::min<int>(word.size(), kMaxWordLength);
+
+  const unsigned char* a = reinterpret_cast<const unsigned char*>(query.data());
+  const unsigned char* b = reinterpret_cast<const unsigned char*>(word.data());
+
+  float D[kRows][kMaxWordLength + 1];
+  auto  row = [&D](int i) { return D[i % kRows]; };
+
+  {
+    float* r0 = row(0);
+    r0[0]     = 0.f;
+    for (int j = 1; j <= m; ++j)
+      r0[j] = r0[j - 1] + m_insert[b[j - 1]];
+  }
+
+  // Confusions whose `read` part ends at the current position of the query (on the stack for the usual tables)
+  constexpr std::size_t           kLocalConfusions = 64;
+  const confusion_t*              local[kLocalConfusions];
+  std::vector<const confusion_t*> heap;
+  const confusion_t**             active = local;
+  if (m_confusions.size() > kLocalConfusions)
+  {
+    heap.resize(m_confusions.size());
+    active = heap.data();
+  }
+
+  for (int i = 1; i <= n; ++i)
+  {
+    float*       r0 = row(i);
+    const float* r1 = row(i - 1);
+    const float* sub = m_subst[a[i - 1]];
+    float        del = m_delete[a[i - 1]];
+
+    int n_active = 0;
+    for (const auto& c : m_confusions)
+    {
+      int k = c.read.size();
+      if (k <= i && query.compare(i - k, k, c.read) == 0)
+        active[n_active++] = &c;
+    }
+
+    r0[0]         = r1[0] + del;
+    float row_min = r0[0];
+    for (int j = 1; j <= m; ++j)
+    {
+      float v = std::min({r1[j - 1] + sub[b[j - 1]], r1[j] + del, r0[j - 1] + m_insert[b[j - 1]]});
+      for (int k = 0; k < n_active; ++k)
+      {
+        const confusion_t& c  = *active[k];
+        int                ke = c.expected.size();
+        if (ke <= j && word.compare(j - ke, ke, c.expected) == 0)
+          v = std::min(v, row(i - (int)c.read.size())[j - ke] + c.cost);
+      }
+      r0[j]   = v;
+      row_min = std::min(row_min, v);
+    }
+
+    // Costs are non-negative, so the distance cannot go below the minimum of the last kRows - 1 rows. We stop
+    // on a single row only when there is no confusion to jump over it.
+    if (m_confusions.empty() && row_min > max_cost)
+      return row_min;
+  }
+  return row(n)[m];
+}
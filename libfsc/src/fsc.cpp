@@ -2,18 +2,53 @@
 
 #include <cstdint>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
 #include <climits>
+#include <cmath>
 #include <deque>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <shared_mutex>
+#include <stdexcept>
 #include <cassert>
 
 #include <iostream>
 
+#include "latency.hpp"
+#include "query_cache.hpp"
+#include "perfect_hash.hpp"
+#include "trie.hpp"
+#include "word_file.hpp"
+
 namespace
 {
   constexpr int        kMaxWordLength = 255;
   static constexpr int kMaxDist = 2;
+
+
+#ifdef FSC_QUERY_COUNTERS
+  thread_local QueryCounters tl_last_query = {};
+  thread_local QueryCounters tl_thread_total = {};
+
+#define FSC_COUNT(name) (++tl_last_query.name)
+#else
+#define FSC_COUNT(name) ((void)0)
+#endif
+
+  // Bounds the counters of a query (in the public entry points)
+  struct query_scope
+  {
+#ifdef FSC_QUERY_COUNTERS
+    query_scope() { tl_last_query = {1, 0, 0, 0, 0, 0}; }
+    ~query_scope() { tl_thread_total += tl_last_query; }
+#endif
+  };
 };
 
 
@@ -22,9 +57,21 @@ struct Dictionary::DictionaryImplBase
   virtual ~DictionaryImplBase() = default;
 
   virtual void              load(std::string_view word_list[], std::size_t n)       = 0;
+  virtual void              load(std::string_view word_list[], std::size_t n, int num_threads) = 0;
   virtual bool              has_matches(std::string_view word, int d) const         = 0;
   virtual DictionaryMatch   best_match(std::string_view word, int d) const          = 0;
+  virtual std::vector<DictionaryMatch> candidates(std::string_view word, int d) const = 0;
   virtual void              add_word(std::string_view word)                         = 0;
+  virtual int               longest_word_length() const noexcept                    = 0;
+  virtual std::size_t       num_words() const                                       = 0;
+  virtual std::uint32_t     word_id(const char* word) const                         = 0;
+  virtual const char*       word(std::uint32_t id) const                            = 0;
+  virtual CacheStats        cache_stats() const                                     = 0;
+  virtual CacheStats        negative_cache_stats() const                            = 0;
+  virtual IndexStats        stats() const                                           = 0;
+  virtual std::vector<std::string> downgraded_words() const                         = 0;
+
+  std::unique_ptr<LatencyRecorder> latency; // Query instrumentation (if enabled)
 };
 
 namespace
@@ -90,113 +137,96 @@ namespace
   using matches_t = std::vector<match_info_t>;
   using dic_map_t = std::unordered_map<const char*, matches_t, string_hash, string_cmp>;
 
-  struct DictionaryImplHashTable final : public Dictionary::DictionaryImplBase
+  // Postings stored contiguously (see DictionaryImplFrozen)
+  struct postings_t
   {
-    void            load(std::string_view word_list[], std::size_t n) final;
-    bool            has_matches(std::string_view word, int d) const final;
-    DictionaryMatch best_match(std::string_view word, int d) const final;
-    void            add_word(std::string_view word) final;
-
-  private:
-    void add_word(char buffer[], int len, int subtr_start, match_info_t from, int max_dist);
-    void get_best_match(char buffer[], int len, int subtr_start, int8_t delpos[], int current_score, int max_score,
-                        DictionaryMatch& best_match, bool stop_first_found) const;
-    const char* insert(const char* new_word, match_info_t from);
+    const match_info_t* first;
+    const match_info_t* last;
 
-    dic_map_t m_dic;
-    std::deque<std::string> m_words;
+    const match_info_t* begin() const { return first; }
+    const match_info_t* end() const { return last; }
+    std::size_t         size() const { return last - first; }
   };
 
-  const char* DictionaryImplHashTable::insert(const char* new_word, match_info_t from)
-  {
-    const char* key;
-    matches_t*  matches;
-
-    if (auto r = m_dic.find(new_word); r != m_dic.end())
-    {
-      key = r->first;
-      matches = &r->second;
-    }
-    else
-    {
-      m_words.push_back(new_word);
-      key     = m_words.back().c_str();
-      matches = &m_dic[key];
-    }
-
-    if (from.get_word() == nullptr)
-      from.set_word(key);
 
-    matches->push_back(from);
-    return key;
+  // Bytes allocated outside of the string object (0 if the small string optimization applies)
+  std::size_t heap_bytes(const std::string& s)
+  {
+    auto p = reinterpret_cast<const char*>(&s);
+    bool inlined = s.data() >= p && s.data() < p + sizeof(s);
+    return inlined ? 0 : s.capacity() + 1;
   }
 
-  void DictionaryImplHashTable::add_word(std::string_view word)
+  // Add a key and its postings to the statistics (but the bytes of the postings). The longest lists are kept as a
+  // min-heap (see finish_stats).
+  template <class Postings>
+  void add_key_stats(const char* key, const Postings& matches, IndexStats& s)
   {
-    char buffer[kMaxWordLength + 1];
-
-    auto len = word.size();
-    if (len >= kMaxWordLength)
-      throw std::runtime_error("Word exceeds max length (255)");
-
-    std::memcpy(buffer, word.data(), len);
-    buffer[len] = 0;
-    this->add_word(buffer, len, 0, match_info_t{}, kMaxDist);
+    auto by_size = [](const auto& a, const auto& b) { return a.second > b.second; };
+
+    std::size_t len = std::strlen(key);
+    if (s.keys_by_length.size() <= len)
+      s.keys_by_length.resize(len + 1);
+    s.keys_by_length[len]++;
+
+    std::size_t n = matches.size();
+    std::size_t log2 = 0;
+    while ((n >> (log2 + 1)) != 0)
+      log2++;
+    if (s.lists_by_log2_size.size() <= log2)
+      s.lists_by_log2_size.resize(log2 + 1);
+    s.lists_by_log2_size[log2]++;
+
+    s.postings += n;
+    for (const auto& m : matches)
+      s.words += (m.get_distance() == 0);
+
+    if (s.longest_lists.size() < IndexStats::kNumLongestLists || n > s.longest_lists.front().second)
+    {
+      if (s.longest_lists.size() == IndexStats::kNumLongestLists)
+      {
+        std::pop_heap(s.longest_lists.begin(), s.longest_lists.end(), by_size);
+        s.longest_lists.pop_back();
+      }
+      s.longest_lists.emplace_back(key, n);
+      std::push_heap(s.longest_lists.begin(), s.longest_lists.end(), by_size);
+    }
   }
 
-  void DictionaryImplHashTable::load(std::string_view word_list[], std::size_t n)
+  // Add the strings of the keys to the statistics
+  void add_key_bytes(const std::deque<std::string>& keys, IndexStats& s)
   {
-    m_dic.clear();
-    m_words.clear();
-
-    for (std::size_t i = 0; i < n; ++i)
-      this->add_word(word_list[i]);
-
-    // Debug dict
-    /*
-        for (auto s : m_words)
-          std::cout << s << "\n";
-
-        for (auto&& [k, v] : m_dic)
-        {
-          std::cout << k << " : ";
-          for (auto m : v)
-            std::cout << m << " " ;
-          std::cout << "\n";
-        }
-        std::cout << std::endl;
-    */
+    // The deque stores the strings in blocks of 512 bytes
+    s.key_bytes += ((keys.size() * sizeof(std::string) + 511) / 512) * 512;
+    for (const auto& k : keys)
+      s.key_bytes += heap_bytes(k);
   }
 
-  void DictionaryImplHashTable::add_word(char buffer[], int len, int subtr_start, match_info_t from, int max_dist)
+  // Add the keys and postings of a table to the statistics
+  void add_stats(const dic_map_t& dic, const std::deque<std::string>& keys, IndexStats& s)
   {
-    assert(from.get_distance() <= max_dist);
-    const char* current_word = this->insert(buffer, from);
-    int         current_distance = from.get_distance();
-
-
-    if (current_distance >= max_dist)
-      return;
+    // Node of std::unordered_map: next pointer, value and cached hash
+    constexpr std::size_t kNodeSize = sizeof(void*) + sizeof(dic_map_t::value_type) + sizeof(std::size_t);
 
+    s.keys += dic.size();
+    s.buckets += dic.bucket_count();
+    s.table_bytes += dic.bucket_count() * sizeof(void*) + dic.size() * kNodeSize;
 
-    if (from.get_word() == nullptr)
-      from.set_word(current_word);
-    from.set_distance(current_distance + 1);
-
-    // Add all deletions of distance +1
-    // Only remove caracters after le last removal
-    for (int i = subtr_start; i < len; ++i)
+    for (const auto& [key, matches] : dic)
     {
-      char c = buffer[i];
-      from.set_deletion_position(current_distance, i + current_distance);
-      from.set_deletion_position(current_distance + 1, -1);
-      std::memmove(buffer + 1, buffer, i);
-      this->add_word(buffer + 1, len - 1, i, from, max_dist);
-      std::memmove(buffer, buffer + 1, i);
-      buffer[i] = c;
+      add_key_stats(key, matches, s);
+      s.posting_bytes += matches.capacity() * sizeof(match_info_t);
     }
+    add_key_bytes(keys, s);
   }
 
+  void finish_stats(IndexStats& s)
+  {
+    s.load_factor = s.buckets ? (double)s.keys / s.buckets : 0.0;
+    std::sort(s.longest_lists.begin(), s.longest_lists.end(), [](const auto& a, const auto& b) {
+      return a.second > b.second || (a.second == b.second && a.first < b.first);
+    });
+  }
 
 
   namespace
@@ -236,184 +266,1688 @@ namespace
 
       return i + j - count_subst;
     }
-  }
-
-  void DictionaryImplHashTable::get_best_match(char buffer[], int len, int substr_start, int8_t del_pos[], int current_score, int max_score, DictionaryMatch& best_match, bool stop_first_found) const
-  {
-    assert(current_score <= best_match.distance);
-    assert(current_score <= max_score);
-
-    if (stop_first_found && best_match.distance <= max_score)
-      return;
 
+    bool is_ascii(std::string_view s)
+    {
+      std::size_t i = 0;
+      for (; i + 8 <= s.size(); i += 8)
+      {
+        std::uint64_t x;
+        std::memcpy(&x, s.data() + i, 8);
+        if (x & 0x8080808080808080ull)
+          return false;
+      }
+      for (; i < s.size(); ++i)
+        if (s[i] & 0x80)
+          return false;
+      return true;
+    }
 
-    auto r        = m_dic.find(buffer);
-    bool found    = r != m_dic.end();
+    // Number of bytes of the UTF-8 character starting at s. Invalid sequences are handled byte per byte.
+    int utf8_char_length(const char* s, int n)
+    {
+      auto c = (unsigned char)s[0];
+      int  k = (c < 0xC0) ? 1 : (c < 0xE0) ? 2 : (c < 0xF0) ? 3 : (c < 0xF8) ? 4 : 1;
+      if (k > n)
+        return 1;
+      for (int i = 1; i < k; ++i)
+        if ((s[i] & 0xC0) != 0x80)
+          return 1;
+      return k;
+    }
 
-    if (found)
+    // Decode (leniently) a UTF-8 string into code points, returns the number of code points
+    int utf8_decode(std::string_view s, char32_t out[])
     {
-      del_pos[current_score] = -1;
-      for (auto m : r->second)
+      int n = 0;
+      for (int i = 0, len = s.size(), k; i < len; i += k)
       {
-        int s;
-
-        // Exact match (only deletion required)
-        if (m.get_distance() == 0)
-        {
-          s = current_score;
-        }
-        else
+        k          = utf8_char_length(s.data() + i, len - i);
+        char32_t c = (unsigned char)s[i];
+        if (k > 1)
         {
-          // Possible substitution instead of indels
-          s = levenshtein_of(del_pos, m.get_deletion_positions());
-          /*
-          std::cout << '[';
-          for (int i = 0; i <= current_score; ++i)
-            std::cout << (int)del_pos[i] << ",";
-          std::cout << "] vs " << m << "\n";
-          std::cout << "(" << buffer << "," << m.get_word() << ") = " << s << "\n";
-          */
+          c &= 0x7F >> k;
+          for (int j = 1; j < k; ++j)
+            c = (c << 6) | (s[i + j] & 0x3F);
         }
+        out[n++] = c;
+      }
+      return n;
+    }
 
-        if (s < best_match.distance)
-        {
-          best_match.distance = s;
-          best_match.word     = m.get_word();
-          best_match.count    = 1;
-          //std::cout << "Best setted (" << buffer << "," << m.get_word() << ") = " << s << "\n";
-        }
-        else if (s == best_match.distance)
+    // Levenshtein distance between a and b, or optimal string alignment distance (Levenshtein + transpositions of
+    // adjacent characters) if `transpositions` is set. Only the diagonal band of width 2 * max_dist + 1 is
+    // computed, any value > max_dist means "more than max_dist".
+    template <class CharT>
+    int bounded_distance(const CharT* a, int n, const CharT* b, int m, int max_dist, bool transpositions)
+    {
+      constexpr int kInf = 2 * kMaxWordLength;
+
+      if (std::abs(n - m) > max_dist)
+        return max_dist + 1;
+
+      int  rows[3][kMaxWordLength + 2];
+      int* r2 = rows[0]; // Row i - 2
+      int* r1 = rows[1]; // Row i - 1
+      int* r0 = rows[2]; // Row i
+
+      for (int j = 0; j <= m; ++j)
+        r1[j] = (j <= max_dist) ? j : kInf;
+
+      for (int i = 1; i <= n; ++i)
+      {
+        int lo = std::max(1, i - max_dist);
+        int hi = std::min(m, i + max_dist);
+
+        r0[lo - 1]  = (lo == 1 && i <= max_dist) ? i : kInf;
+        int row_min = r0[lo - 1];
+        for (int j = lo; j <= hi; ++j)
         {
-          best_match.count += 1;
+          int v = std::min({r1[j - 1] + (a[i - 1] != b[j - 1]), r1[j] + 1, r0[j - 1] + 1});
+          if (transpositions && i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1])
+            v = std::min(v, r2[j - 2] + 1);
+          r0[j]   = v;
+          row_min = std::min(row_min, v);
         }
+        if (hi < m)
+          r0[hi + 1] = kInf;
 
-        // If it is exact, we cannot do better
-        if (m.get_distance() == 0)
-          break;
+        if (row_min > max_dist)
+          return max_dist + 1;
+
+        std::swap(r2, r1);
+        std::swap(r1, r0);
       }
+      return std::min(r1[m], max_dist + 1);
     }
 
-    // Avoid useless computations that would not improve the score
-    if ((current_score + 1) >= best_match.distance || (current_score + 1) > max_score)
-      return;
-
-    // If find-only
-    if (stop_first_found && best_match.distance <= max_score)
-      return;
+    int osa_distance(std::string_view a, std::string_view b, int max_dist)
+    {
+      return bounded_distance(a.data(), a.size(), b.data(), b.size(), max_dist, true);
+    }
 
-    // Try suppressions
-    // Only remove caracters after le last removal
-    for (int i = substr_start; i < len; ++i)
+    int osa_distance_utf8(std::string_view a, std::string_view b, int max_dist)
     {
-      char c = buffer[i];
-      del_pos[current_score] = i + current_score;
-      del_pos[current_score + 1] = -1;
+      char32_t ua[kMaxWordLength + 1];
+      char32_t ub[kMaxWordLength + 1];
+      int      n = utf8_decode(a, ua);
+      int      m = utf8_decode(b, ub);
+      return bounded_distance(ua, n, ub, m, max_dist, true);
+    }
+  }
 
-      std::memmove(buffer + 1, buffer, i);
-      get_best_match(buffer + 1, len - 1, i, del_pos, current_score + 1, max_score, best_match, stop_first_found);
-      std::memmove(buffer, buffer + 1, i);
 
-      buffer[i] = c;
-    }
+  constexpr int kLongWordLength = 16; // The deletions of longer words do not fit in the small string optimization
+
+  // Estimated memory of a word in the indexes, calibrated on IndexStats. The deletion index has a posting per
+  // deletion of at most kMaxDist (2) characters, about 100 bytes each (node, bucket, key string, posting) plus the
+  // key itself when it is long. The trie has at most one node (16 bytes, 24 with the vector growth) per character.
+  double deletion_index_bytes(int len)
+  {
+    double postings = 1 + len + len * (len - 1) / 2.0;
+    return postings * (100 + (len >= kLongWordLength ? len : 0));
   }
 
-  bool DictionaryImplHashTable::has_matches(std::string_view word, int d) const
+  double trie_bytes(int len) { return 25.0 * len + 1; }
+
+  // A word kept out of the index (see DictionaryOptions::memory_budget): its string and a pointer
+  double unindexed_bytes(int len) { return len + 1 + sizeof(std::string) + 2 * sizeof(void*); }
+
+
+  DictionaryMatch no_match()
   {
-    DictionaryMatch best_match;
-    best_match.distance = INT_MAX;
-    best_match.count = 0;
-    best_match.word = nullptr;
+    DictionaryMatch m;
+    m.word              = nullptr;
+    m.distance          = INT_MAX;
+    m.count             = 0;
+    m.weighted_distance = INFINITY;
+    return m;
+  }
+
+  struct candidate_t
+  {
+    const char* word;
+    int         distance;
+  };
+
+  // State of a query shared by all the levels of the search
+  struct search_context_t
+  {
+    std::string_view          word;             // The original query
+    int                       max_score;        // The maximal number of deletions in the query
+    bool                      stop_first_found; // Stop as soon as a match <= max_score is found (has_matches)
+    bool                      transpositions;   // Count the swap of two adjacent characters as a single edit
+    std::vector<candidate_t>* candidates;       // If set, collect the candidates <= max_score (weighted ranking)
+    std::vector<const char*>* ties;             // If set, the words at the best distance (each one counted once)
+    bool                      exact_count;      // Search all the ties (otherwise stop at the first distance found)
+  };
+
 
+  // Word bookkeeping and query entry points shared by the implementations (normalization, original spellings, word
+  // ids, caches, ranking by edit costs). The index itself is provided by the derived class with:
+  // * const char* insert_word(char buffer[], int len)
+  //   that adds a prepared word (buffer can be modified) and returns a stable pointer to its stored copy
+  // * void search(const search_context_t& ctx, DictionaryMatch& best_match) const
+  //   that searches the prepared query ctx.word (null-terminated) as described by the context
+  // * void collect_stats(IndexStats& s) const
+  //   that adds its tables to the statistics (see add_stats)
+  // * double projected_bytes(int len) const
+  //   that estimates the memory of a word of len bytes in the index (for the memory budget)
+  //
+  // With a memory budget, the words that would not fit are kept out of the index and compared to each query.
+  struct DictionaryImplCommon : public Dictionary::DictionaryImplBase
+  {
+    explicit DictionaryImplCommon(const DictionaryOptions& options)
+      : m_transpositions(options.transpositions)
+      , m_exact_count(options.exact_count)
+      , m_utf8(options.utf8)
+      , m_normalization(options.normalization)
+      , m_utf8_normalization(options.utf8 || options.utf8_normalization)
+      , m_edit_costs(options.edit_costs)
+      , m_memory_budget(options.memory_budget)
+    {
+      if (options.cache_capacity > 0)
+        m_cache = std::make_unique<QueryCache>(options.cache_capacity);
+      if (options.negative_cache_capacity > 0)
+        m_negative_cache = std::make_unique<NegativeCache>(options.negative_cache_capacity);
+    }
 
+    bool            has_matches(std::string_view word, int d) const final;
+    DictionaryMatch best_match(std::string_view word, int d) const final;
+    void            add_word(std::string_view word) override;
 
-    auto n = word.size();
-    char    buffer[256];
-    int8_t  del_pos[256] = {-1};
+    std::vector<DictionaryMatch> candidates(std::string_view word, int d) const final;
 
-    std::memcpy(buffer, word.data(), n);
-    buffer[n] = 0;
+    int longest_word_length() const noexcept final { return m_longest_word.load(std::memory_order_relaxed); }
 
-    this->get_best_match(buffer, n, 0, del_pos, 0, d, best_match, true);
-    assert((best_match.distance == INT_MAX) == (best_match.word == nullptr));
+    std::size_t   num_words() const final;
+    std::uint32_t word_id(const char* word) const final;
+    const char*   word(std::uint32_t id) const final;
 
-    return best_match.distance <= d;
-  }
+    CacheStats cache_stats() const final { return m_cache ? m_cache->stats() : CacheStats{0, 0, 0, 0}; }
+    CacheStats negative_cache_stats() const final
+    {
+      return m_negative_cache ? m_negative_cache->stats() : CacheStats{0, 0, 0, 0};
+    }
+
+    IndexStats stats() const final;
+
+    std::vector<std::string> downgraded_words() const final;
+
+  protected:
+    virtual const char* insert_word(char buffer[], int len)                                   = 0;
+    virtual void        search(const search_context_t& ctx, DictionaryMatch& best_match) const = 0;
+    virtual void        collect_stats(IndexStats& s) const                                     = 0;
+    virtual double      projected_bytes(int len) const                                         = 0;
+
+    // Copy the (normalized) word in buffer and returns its length
+    int         prepare(std::string_view word, char buffer[]) const;
+    // The original spelling of a normalized word of the dictionary
+    const char* original_of(const char* word) const;
+    // Clear the state of the base and plan the memory budget for the words to load
+    void        reset(const std::string_view word_list[], std::size_t n);
+
+    bool                             m_transpositions;
+    bool                             m_exact_count;
+    bool                             m_utf8;
+
+  private:
+    // Search the index and the words kept out of it
+    void            search_all(const search_context_t& ctx, DictionaryMatch& best_match) const;
+    void            search_unindexed(const search_context_t& ctx, DictionaryMatch& best_match) const;
+    bool            keep_unindexed(int len);
+    const char*     insert_unindexed(const char word[], int len);
+
+    DictionaryMatch search_best_match(const char query[], int n, int d) const;
+    DictionaryMatch rank_candidates(std::string_view word, std::vector<candidate_t>& candidates) const;
+    void            collect_candidates(const char query[], int n, int d, std::vector<candidate_t>& out) const;
+
+    Normalization                    m_normalization;
+    bool                             m_utf8_normalization;
+    std::shared_ptr<const EditCosts> m_edit_costs;
+
+    // Normalized word -> original spelling (only for the words changed by the normalization) and the table of the
+    // distinct words (by returned spelling) for their ids
+    mutable std::shared_mutex                      m_originals_mutex;
+    std::deque<std::string>                        m_originals;
+    std::unordered_map<const char*, const char*>   m_original_of;
+    std::vector<const char*>                       m_word_table;
+    std::unordered_map<const char*, std::uint32_t> m_word_id;
+
+    std::atomic<int> m_longest_word = 0; // Length (in bytes) of the longest (normalized) word
+
+    // Query results, tagged with the generation of the dictionary (incremented by each change)
+    std::unique_ptr<QueryCache>    m_cache;
+    std::unique_ptr<NegativeCache> m_negative_cache;
+    std::atomic<std::uint64_t>     m_generation = 0;
+
+    // Memory budget: the words of m_unindexed_length bytes or more (planned on load), and those that would exceed
+    // the budget afterwards, are stored out of the index
+    std::size_t                           m_memory_budget;
+    int                                   m_unindexed_length = INT_MAX;
+    std::atomic<std::uint64_t>            m_projected_bytes  = 0;
+    mutable std::shared_mutex             m_unindexed_mutex;
+    std::unordered_set<std::string>       m_unindexed;
+    std::vector<std::vector<const char*>> m_unindexed_by_length;
+    std::atomic<std::size_t>              m_num_unindexed = 0;
+  };
 
 
-  DictionaryMatch DictionaryImplHashTable::best_match(std::string_view word, int d) const
+  // Symmetric-deletion index logic shared by the implementations. The storage is provided by the derived class
+  // with:
+  // * const char* insert(const char* key, match_info_t from)
+  //   that adds a posting to the key and returns a stable pointer to the stored key
+  // * bool lookup(const char* key, F&& visit) const
+  //   that calls visit with the postings of the key (if any), a range of match_info_t
+  // and collect_stats (see DictionaryImplCommon)
+  template <class Derived>
+  struct DictionaryImplDeletionBase : public DictionaryImplCommon
   {
-    DictionaryMatch best_match;
-    best_match.distance = INT_MAX;
-    best_match.count = 0;
-    best_match.word = nullptr;
+    using DictionaryImplCommon::DictionaryImplCommon;
+    using DictionaryImplCommon::add_word;
+
+  protected:
+    const char* insert_word(char buffer[], int len) final;
+    void        search(const search_context_t& ctx, DictionaryMatch& best_match) const final;
+    double      projected_bytes(int len) const final { return deletion_index_bytes(len); }
+
+    // In Utf8 mode, deletions remove whole code points and positions are counted in code points.
+    // `subtr_start` is a byte offset in the buffer and `pos_start` the corresponding code point index.
+    template <bool Utf8>
+    const char* add_word(char buffer[], int len, int subtr_start, int pos_start, match_info_t from, int max_dist);
+    template <bool Utf8>
+    void get_best_match(char buffer[], int len, int subtr_start, int pos_start, int8_t delpos[], int current_score,
+                        const search_context_t& ctx, DictionaryMatch& best_match) const;
 
-    auto    n = word.size();
-    char    buffer[256];
-    int8_t  del_pos[256] = {-1};
-    std::memcpy(buffer, word.data(), n);
-    buffer[n] = 0;
+  private:
+    Derived*       derived() { return static_cast<Derived*>(this); }
+    const Derived* derived() const { return static_cast<const Derived*>(this); }
+  };
 
-    this->get_best_match(buffer, n, 0, del_pos, 0, d, best_match, false);
-    assert((best_match.distance == INT_MAX) == (best_match.word == nullptr));
 
-    return best_match;
+  int DictionaryImplCommon::prepare(std::string_view word, char buffer[]) const
+  {
+    int len = any(m_normalization) ? normalize(word, buffer, m_normalization, m_utf8_normalization) : word.size();
+    if (!any(m_normalization))
+      std::memcpy(buffer, word.data(), len);
+    buffer[len] = 0;
+    return len;
   }
 
-} // namespace
+  const char* DictionaryImplCommon::original_of(const char* word) const
+  {
+    if (word == nullptr || !any(m_normalization))
+      return word;
 
-Dictionary::Dictionary()
-{
-  m_impl = std::make_unique<DictionaryImplHashTable>();
-}
+    std::shared_lock<std::shared_mutex> lock(m_originals_mutex);
+    auto                                r = m_original_of.find(word);
+    return (r != m_original_of.end()) ? r->second : word;
+  }
 
+  IndexStats DictionaryImplCommon::stats() const
+  {
+    IndexStats s = {};
+    this->collect_stats(s);
+    {
+      std::shared_lock<std::shared_mutex> lock(m_originals_mutex);
+      s.other_bytes += ((m_originals.size() * sizeof(std::string) + 511) / 512) * 512;
+      for (const auto& w : m_originals)
+        s.other_bytes += heap_bytes(w);
+      s.other_bytes += m_original_of.bucket_count() * sizeof(void*) +
+                       m_original_of.size() * (sizeof(void*) + 2 * sizeof(const char*));
+      s.other_bytes += m_word_table.capacity() * sizeof(const char*) + m_word_id.bucket_count() * sizeof(void*) +
+                       m_word_id.size() * (sizeof(void*) + sizeof(const char*) + sizeof(std::uint64_t));
+    }
+    {
+      std::shared_lock<std::shared_mutex> lock(m_unindexed_mutex);
+      s.downgraded = m_unindexed.size();
+      for (const auto& w : m_unindexed)
+        s.other_bytes += unindexed_bytes(w.size());
+    }
+    finish_stats(s);
+    return s;
+  }
 
-Dictionary::~Dictionary()
-{
-}
+  std::size_t DictionaryImplCommon::num_words() const
+  {
+    std::shared_lock<std::shared_mutex> lock(m_originals_mutex);
+    return m_word_table.size();
+  }
 
+  std::uint32_t DictionaryImplCommon::word_id(const char* word) const
+  {
+    std::shared_lock<std::shared_mutex> lock(m_originals_mutex);
+    auto                                r = m_word_id.find(word);
+    return (r != m_word_id.end()) ? r->second : Dictionary::kNoWord;
+  }
 
-void Dictionary::load(std::string_view word_list[], std::size_t n)
-{
-  m_impl->load(word_list, n);
-}
+  const char* DictionaryImplCommon::word(std::uint32_t id) const
+  {
+    std::shared_lock<std::shared_mutex> lock(m_originals_mutex);
+    if (id >= m_word_table.size())
+      throw std::runtime_error("Invalid word id");
+    return m_word_table[id];
+  }
 
-void Dictionary::add_word(std::string_view word)
-{
-  m_impl->add_word(word);
-}
+  void DictionaryImplCommon::reset(const std::string_view word_list[], std::size_t n)
+  {
+    {
+      std::unique_lock<std::shared_mutex> lock(m_originals_mutex);
+      m_original_of.clear();
+      m_originals.clear();
+      m_word_table.clear();
+      m_word_id.clear();
+      m_longest_word = 0;
+    }
+    {
+      std::unique_lock<std::shared_mutex> lock(m_unindexed_mutex);
+      m_unindexed.clear();
+      m_unindexed_by_length.clear();
+      m_num_unindexed = 0;
+    }
+    m_projected_bytes  = 0;
+    m_unindexed_length = INT_MAX;
+
+    // Keep the longest words (the most expensive ones) out of the index until the projection fits the budget
+    if (m_memory_budget > 0)
+    {
+      std::vector<double> indexed(kMaxWordLength + 1), unindexed(kMaxWordLength + 1);
+      double              total = 0;
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        int len = std::min<int>(word_list[i].size(), kMaxWordLength);
+        indexed[len] += this->projected_bytes(len);
+        unindexed[len] += unindexed_bytes(len);
+        total += this->projected_bytes(len);
+      }
 
+      int l = kMaxWordLength + 1;
+      while (l > 0 && total > m_memory_budget)
+      {
+        --l;
+        total += unindexed[l] - indexed[l];
+      }
+      if (l <= kMaxWordLength)
+        m_unindexed_length = l;
+    }
 
-namespace
-{
-  void check_params(std::string_view word, int d)
+    m_generation.fetch_add(1, std::memory_order_release);
+  }
+
+  bool DictionaryImplCommon::keep_unindexed(int len)
   {
-    if (d > kMaxDist)
-      throw std::runtime_error("Invalid distance (Must be <= 2)");
+    if (m_memory_budget == 0)
+      return false;
+    if (len >= m_unindexed_length)
+      return true;
+
+    // The cost is reserved first (the Sharded backend inserts concurrently)
+    auto cost      = (std::uint64_t)this->projected_bytes(len);
+    auto projected = m_projected_bytes.fetch_add(cost, std::memory_order_relaxed) + cost;
+    if (projected <= m_memory_budget)
+      return false;
+    m_projected_bytes.fetch_sub(cost, std::memory_order_relaxed);
+    return true;
+  }
 
-    if (word.size() > kMaxWordLength)
-      throw std::runtime_error("Word too long (should be <= 255)");
+  const char* DictionaryImplCommon::insert_unindexed(const char word[], int len)
+  {
+    // A word already in the index stays there
+    DictionaryMatch  found = no_match();
+    search_context_t ctx   = {{word, (std::size_t)len}, 0, true, false, nullptr, nullptr, false};
+    this->search(ctx, found);
+    if (found.distance == 0)
+      return found.word;
+
+    std::unique_lock<std::shared_mutex> lock(m_unindexed_mutex);
+    auto [it, added] = m_unindexed.emplace(word, len);
+    if (added)
+    {
+      if ((int)m_unindexed_by_length.size() <= len)
+        m_unindexed_by_length.resize(len + 1);
+      m_unindexed_by_length[len].push_back(it->c_str());
+      m_num_unindexed.fetch_add(1, std::memory_order_release);
+    }
+    return it->c_str();
   }
-}
 
+  std::vector<std::string> DictionaryImplCommon::downgraded_words() const
+  {
+    std::vector<std::string> words;
+    std::shared_lock<std::shared_mutex> lock(m_unindexed_mutex);
+    for (const auto& by_length : m_unindexed_by_length)
+      for (const char* w : by_length)
+        words.emplace_back(this->original_of(w));
+    return words;
+  }
 
-bool Dictionary::has_matches(std::string_view word, int d)
-{
-  check_params(word, d);
-  return m_impl->has_matches(word, d);
-}
+  void DictionaryImplCommon::search_all(const search_context_t& ctx, DictionaryMatch& best_match) const
+  {
+    this->search(ctx, best_match);
+    this->search_unindexed(ctx, best_match);
+  }
 
+  // Compare the query to the words out of the index whose length is compatible with the max distance
+  void DictionaryImplCommon::search_unindexed(const search_context_t& ctx, DictionaryMatch& best_match) const
+  {
+    if (m_num_unindexed.load(std::memory_order_acquire) == 0)
+      return;
+    if (ctx.stop_first_found && best_match.distance <= ctx.max_score)
+      return;
 
+    char32_t query[kMaxWordLength + 1];
+    char32_t word[kMaxWordLength + 1];
+    int      n      = ctx.word.size();
+    int      n_char = m_utf8 ? utf8_decode(ctx.word, query) : n;
+    int      window = m_utf8 ? 4 * ctx.max_score : ctx.max_score; // A UTF-8 character has up to 4 bytes
 
-int Dictionary::max_word_length() const noexcept
-{
-  return kMaxWordLength;
-}
+    std::shared_lock<std::shared_mutex> lock(m_unindexed_mutex);
+    int last = std::min<int>(n + window, (int)m_unindexed_by_length.size() - 1);
+    for (int len = std::max(0, n - window); len <= last; ++len)
+    {
+      for (const char* w : m_unindexed_by_length[len])
+      {
+        int bound = ctx.candidates ? ctx.max_score : std::min(ctx.max_score, best_match.distance);
+        FSC_COUNT(distance_calls);
 
+        int dist;
+        if (m_utf8)
+        {
+          int m = utf8_decode({w, (std::size_t)len}, word);
+          dist  = bounded_distance(query, n_char, word, m, bound, ctx.transpositions);
+        }
+        else
+          dist = bounded_distance(ctx.word.data(), n, w, len, bound, ctx.transpositions);
+        if (dist > bound)
+          continue;
 
-DictionaryMatch Dictionary::best_match(std::string_view word, int d)
-{
+        if (ctx.candidates != nullptr)
+          ctx.candidates->push_back({w, dist});
+        else if (dist < best_match.distance)
+        {
+          best_match.distance = dist;
+          best_match.word     = w;
+          best_match.count    = 1;
+          if (ctx.ties)
+            ctx.ties->assign(1, w);
+        }
+        else if (ctx.ties)
+          ctx.ties->push_back(w);
+        else
+          best_match.count += 1;
+        if (ctx.stop_first_found)
+          return;
+      }
+    }
+  }
+
+  void DictionaryImplCommon::add_word(std::string_view word)
+  {
+    char buffer[kMaxWordLength + 1];
+
+    if (word.size() >= kMaxWordLength)
+      throw std::runtime_error("Word exceeds max length (255)");
+
+    int len = this->prepare(word, buffer);
+
+    for (int l = m_longest_word.load(std::memory_order_relaxed); l < len;)
+      if (m_longest_word.compare_exchange_weak(l, len, std::memory_order_relaxed))
+        break;
+
+    const char* key = this->keep_unindexed(len) ? this->insert_unindexed(buffer, len) : this->insert_word(buffer, len);
+
+    {
+      std::unique_lock<std::shared_mutex> lock(m_originals_mutex);
+
+      // The first spelling of a normalized word is the one returned
+      const char* spelling = key;
+      if (any(m_normalization))
+      {
+        auto r = m_original_of.find(key);
+        if (r != m_original_of.end())
+          spelling = r->second;
+        else if (word != key && m_word_id.count(key) == 0)
+        {
+          m_originals.emplace_back(word);
+          spelling = m_originals.back().c_str();
+          m_original_of.emplace(key, spelling);
+        }
+      }
+
+      if (m_word_id.emplace(spelling, (std::uint32_t)m_word_table.size()).second)
+        m_word_table.push_back(spelling);
+    }
+
+    // Invalidate the cached results
+    m_generation.fetch_add(1, std::memory_order_release);
+  }
+
+  bool DictionaryImplCommon::has_matches(std::string_view word, int d) const
+  {
+    DictionaryMatch best_match;
+    best_match.distance = INT_MAX;
+    best_match.count = 0;
+    best_match.word = nullptr;
+
+    char query[256];
+    int  n          = this->prepare(word, query);
+    auto generation = m_generation.load(std::memory_order_acquire);
+    if (m_negative_cache && m_negative_cache->find({query, (std::size_t)n}, d, generation))
+      return false;
+    if (m_cache && m_cache->find({query, (std::size_t)n}, d, QueryCache::kHasMatches, generation, best_match))
+      return best_match.distance <= d;
+
+    search_context_t ctx = {{query, (std::size_t)n}, d, true, m_transpositions, nullptr, nullptr, false};
+    this->search_all(ctx, best_match);
+    assert((best_match.distance == INT_MAX) == (best_match.word == nullptr));
+
+    bool found = best_match.distance <= d;
+    if (m_negative_cache && !found)
+      m_negative_cache->insert({query, (std::size_t)n}, d, generation);
+    else if (m_cache)
+      m_cache->insert({query, (std::size_t)n}, d, QueryCache::kHasMatches, generation, best_match);
+    return found;
+  }
+
+
+  DictionaryMatch DictionaryImplCommon::best_match(std::string_view word, int d) const
+  {
+    char query[256];
+    int  n          = this->prepare(word, query);
+    auto generation = m_generation.load(std::memory_order_acquire);
+
+    // With the negative cache, the matches farther than d are never reported (whether the miss is cached or not)
+    if (m_negative_cache && m_negative_cache->find({query, (std::size_t)n}, d, generation))
+      return no_match();
+
+    DictionaryMatch best_match;
+    if (m_cache && m_cache->find({query, (std::size_t)n}, d, QueryCache::kBestMatch, generation, best_match))
+      return best_match;
+
+    best_match = this->search_best_match(query, n, d);
+    if (m_negative_cache && best_match.distance > d)
+    {
+      m_negative_cache->insert({query, (std::size_t)n}, d, generation);
+      return no_match();
+    }
+
+    if (m_cache)
+      m_cache->insert({query, (std::size_t)n}, d, QueryCache::kBestMatch, generation, best_match);
+    return best_match;
+  }
+
+  DictionaryMatch DictionaryImplCommon::search_best_match(const char query[], int n, int d) const
+  {
+    DictionaryMatch best_match;
+    best_match.distance = INT_MAX;
+    best_match.count = 0;
+    best_match.word = nullptr;
+
+    if (m_edit_costs)
+    {
+      std::vector<candidate_t> candidates;
+      this->collect_candidates(query, n, d, candidates);
+      best_match      = this->rank_candidates({query, (std::size_t)n}, candidates);
+      best_match.word = this->original_of(best_match.word);
+      return best_match;
+    }
+
+    std::vector<const char*> ties;
+    search_context_t         ctx = {{query, (std::size_t)n}, d, false, m_transpositions, nullptr, &ties, m_exact_count};
+    this->search_all(ctx, best_match);
+    assert((best_match.distance == INT_MAX) == (best_match.word == nullptr));
+
+    // Each word at the best distance once
+    if (!ties.empty())
+    {
+      std::sort(ties.begin(), ties.end());
+      best_match.count = (int)(std::unique(ties.begin(), ties.end()) - ties.begin());
+    }
+
+    best_match.weighted_distance = best_match.distance;
+    best_match.word              = this->original_of(best_match.word);
+    return best_match;
+  }
+
+  // Collect the words at a distance <= d of the prepared query (each one once)
+  void DictionaryImplCommon::collect_candidates(const char query[], int n, int d,
+                                                std::vector<candidate_t>& candidates) const
+  {
+    DictionaryMatch best_match;
+    best_match.distance = INT_MAX;
+    best_match.count    = 0;
+    best_match.word     = nullptr;
+
+    search_context_t ctx = {{query, (std::size_t)n}, d, false, m_transpositions, &candidates, nullptr, false};
+    this->search_all(ctx, best_match);
+
+    // A word may be reached by several paths of the search, keep its smallest edit distance
+    std::sort(candidates.begin(), candidates.end(), [](const candidate_t& a, const candidate_t& b) {
+      return a.word < b.word || (a.word == b.word && a.distance < b.distance);
+    });
+    auto last = std::unique(candidates.begin(), candidates.end(),
+                            [](const candidate_t& a, const candidate_t& b) { return a.word == b.word; });
+    candidates.erase(last, candidates.end());
+  }
+
+  std::vector<DictionaryMatch> DictionaryImplCommon::candidates(std::string_view word, int d) const
+  {
+    char                     query[256];
+    std::vector<candidate_t> candidates;
+    int                      n = this->prepare(word, query);
+    this->collect_candidates(query, n, d, candidates);
+
+    std::vector<DictionaryMatch> result;
+    result.reserve(candidates.size());
+    for (auto c : candidates)
+    {
+      DictionaryMatch m;
+      m.word              = c.word;
+      m.distance          = c.distance;
+      m.count             = 1;
+      m.weighted_distance = m_edit_costs ? m_edit_costs->weighted_distance(query, c.word, INFINITY) : c.distance;
+      m.word              = this->original_of(c.word);
+      result.push_back(m);
+    }
+
+    // Closest first, then by original spelling
+    std::sort(result.begin(), result.end(), [](const DictionaryMatch& a, const DictionaryMatch& b) {
+      if (a.weighted_distance != b.weighted_distance)
+        return a.weighted_distance < b.weighted_distance;
+      if (a.distance != b.distance)
+        return a.distance < b.distance;
+      return std::strcmp(a.word, b.word) < 0;
+    });
+    return result;
+  }
+
+  DictionaryMatch DictionaryImplCommon::rank_candidates(std::string_view word,
+                                                                       std::vector<candidate_t>& candidates) const
+  {
+    constexpr float kEpsilon = 1e-5f;
+
+    DictionaryMatch best_match;
+    best_match.distance          = INT_MAX;
+    best_match.count             = 0;
+    best_match.word              = nullptr;
+    best_match.weighted_distance = INFINITY;
+
+    for (auto c = candidates.begin(); c != candidates.end(); ++c)
+    {
+      float w = m_edit_costs->weighted_distance(word, c->word, best_match.weighted_distance + kEpsilon);
+      if (w < best_match.weighted_distance - kEpsilon)
+      {
+        best_match.weighted_distance = w;
+        best_match.distance          = c->distance;
+        best_match.word              = c->word;
+        best_match.count             = 1;
+      }
+      else if (w <= best_match.weighted_distance + kEpsilon)
+      {
+        best_match.count += 1;
+      }
+    }
+    return best_match;
+  }
+
+
+  template <class Derived>
+  template <bool Utf8>
+  const char* DictionaryImplDeletionBase<Derived>::add_word(char buffer[], int len, int subtr_start, int pos_start,
+                                                            match_info_t from, int max_dist)
+  {
+    assert(from.get_distance() <= max_dist);
+    const char* current_word = derived()->insert(buffer, from);
+    int         current_distance = from.get_distance();
+
+
+    if (current_distance >= max_dist)
+      return current_word;
+
+
+    if (from.get_word() == nullptr)
+      from.set_word(current_word);
+    from.set_distance(current_distance + 1);
+
+    // Add all deletions of distance +1
+    // Only remove caracters after le last removal
+    int k;
+    for (int i = subtr_start, p = pos_start; i < len; i += k, ++p)
+    {
+      k = Utf8 ? utf8_char_length(buffer + i, len - i) : 1;
+
+      char c[4];
+      std::memcpy(c, buffer + i, k);
+      from.set_deletion_position(current_distance, p + current_distance);
+      from.set_deletion_position(current_distance + 1, -1);
+      std::memmove(buffer + k, buffer, i);
+      this->add_word<Utf8>(buffer + k, len - k, i, p, from, max_dist);
+      std::memmove(buffer, buffer + k, i);
+      std::memcpy(buffer + i, c, k);
+    }
+    return current_word;
+  }
+
+
+  template <class Derived>
+  template <bool Utf8>
+  void DictionaryImplDeletionBase<Derived>::get_best_match(char buffer[], int len, int substr_start, int pos_start,
+                                                           int8_t del_pos[], int current_score,
+                                                           const search_context_t& ctx,
+                                                           DictionaryMatch& best_match) const
+  {
+    assert(current_score <= best_match.distance);
+    assert(current_score <= ctx.max_score);
+
+    if (ctx.stop_first_found && best_match.distance <= ctx.max_score)
+    {
+      FSC_COUNT(early_exits);
+      return;
+    }
+
+    FSC_COUNT(variants);
+    derived()->lookup(buffer, [&](const auto& matches) {
+      FSC_COUNT(key_hits);
+      del_pos[current_score] = -1;
+      for (auto m : matches)
+      {
+        FSC_COUNT(postings);
+        int s;
+
+        // Exact match (only deletion required)
+        if (m.get_distance() == 0)
+        {
+          s = current_score;
+        }
+        else
+        {
+          // Possible substitution instead of indels
+          FSC_COUNT(distance_calls);
+          s = levenshtein_of(del_pos, m.get_deletion_positions());
+
+          // A transposition shows up as two indels (or substitutions) and saves at least one edit. The score is
+          // kept >= current_score as for the deletion-based distance (closer words are scored on a shorter path).
+          if (ctx.transpositions && s >= 2 && s - 1 >= current_score && s - 1 <= best_match.distance)
+            s = std::max(current_score, m_utf8 ? osa_distance_utf8(ctx.word, m.get_word(), s - 1)
+                                                      : osa_distance(ctx.word, m.get_word(), s - 1));
+        }
+
+        if (ctx.candidates != nullptr)
+        {
+          // Weighted ranking is done once all the candidates are known
+          if (s <= ctx.max_score)
+            ctx.candidates->push_back({m.get_word(), s});
+        }
+        else if (s < best_match.distance)
+        {
+          best_match.distance = s;
+          best_match.word     = m.get_word();
+          best_match.count    = 1;
+          if (ctx.ties)
+            ctx.ties->assign(1, m.get_word());
+        }
+        else if (s == best_match.distance)
+        {
+          // A word can be reached from several deletions of the query: the ties are counted once the search is done
+          if (ctx.ties)
+            ctx.ties->push_back(m.get_word());
+          else
+            best_match.count += 1;
+        }
+
+        // If it is exact, we cannot do better (but the other candidates and ties are still wanted)
+        if (m.get_distance() == 0 && ctx.candidates == nullptr && !ctx.exact_count)
+        {
+          FSC_COUNT(early_exits);
+          break;
+        }
+      }
+    });
+
+    // Avoid useless computations that would not improve the score (or find a tie when counting them)
+    if ((current_score + 1) - ctx.exact_count >= best_match.distance || (current_score + 1) > ctx.max_score)
+    {
+      FSC_COUNT(early_exits);
+      return;
+    }
+
+    // If find-only
+    if (ctx.stop_first_found && best_match.distance <= ctx.max_score)
+    {
+      FSC_COUNT(early_exits);
+      return;
+    }
+
+    // Try suppressions
+    // Only remove caracters after le last removal
+    int k;
+    for (int i = substr_start, p = pos_start; i < len; i += k, ++p)
+    {
+      k = Utf8 ? utf8_char_length(buffer + i, len - i) : 1;
+
+      char c[4];
+      std::memcpy(c, buffer + i, k);
+      del_pos[current_score] = p + current_score;
+      del_pos[current_score + 1] = -1;
+
+      std::memmove(buffer + k, buffer, i);
+      get_best_match<Utf8>(buffer + k, len - k, i, p, del_pos, current_score + 1, ctx, best_match);
+      std::memmove(buffer, buffer + k, i);
+
+      std::memcpy(buffer + i, c, k);
+    }
+  }
+
+  template <class Derived>
+  const char* DictionaryImplDeletionBase<Derived>::insert_word(char buffer[], int len)
+  {
+    // Pure ASCII words have the same deletions in both modes
+    if (m_utf8 && !is_ascii({buffer, (std::size_t)len}))
+      return this->add_word<true>(buffer, len, 0, 0, match_info_t{}, kMaxDist);
+    return this->add_word<false>(buffer, len, 0, 0, match_info_t{}, kMaxDist);
+  }
+
+  template <class Derived>
+  void DictionaryImplDeletionBase<Derived>::search(const search_context_t& ctx, DictionaryMatch& best_match) const
+  {
+    char   buffer[256];
+    int8_t del_pos[256] = {-1};
+    int    len          = ctx.word.size();
+
+    std::memcpy(buffer, ctx.word.data(), len + 1);
+    if (m_utf8 && !is_ascii(ctx.word))
+      this->get_best_match<true>(buffer, len, 0, 0, del_pos, 0, ctx, best_match);
+    else
+      this->get_best_match<false>(buffer, len, 0, 0, del_pos, 0, ctx, best_match);
+  }
+
+  struct DictionaryImplHashTable final : public DictionaryImplDeletionBase<DictionaryImplHashTable>
+  {
+    using DictionaryImplDeletionBase::DictionaryImplDeletionBase;
+
+    void load(std::string_view word_list[], std::size_t n) final;
+    // The table does not support concurrent insertions
+    void load(std::string_view word_list[], std::size_t n, int) final { this->load(word_list, n); }
+
+    const char* insert(const char* new_word, match_info_t from);
+
+    template <class F>
+    bool lookup(const char* key, F&& visit) const
+    {
+      auto r = m_dic.find(key);
+      if (r == m_dic.end())
+        return false;
+      visit(r->second);
+      return true;
+    }
+
+    void collect_stats(IndexStats& s) const final { add_stats(m_dic, m_words, s); }
+
+  private:
+    dic_map_t m_dic;
+    std::deque<std::string> m_words;
+  };
+
+  const char* DictionaryImplHashTable::insert(const char* new_word, match_info_t from)
+  {
+    const char* key;
+    matches_t*  matches;
+
+    if (auto r = m_dic.find(new_word); r != m_dic.end())
+    {
+      key = r->first;
+      matches = &r->second;
+    }
+    else
+    {
+      m_words.push_back(new_word);
+      key     = m_words.back().c_str();
+      matches = &m_dic[key];
+    }
+
+    if (from.get_word() == nullptr)
+      from.set_word(key);
+
+    matches->push_back(from);
+    return key;
+  }
+
+  void DictionaryImplHashTable::load(std::string_view word_list[], std::size_t n)
+  {
+    m_dic.clear();
+    m_words.clear();
+    this->reset(word_list, n);
+
+    for (std::size_t i = 0; i < n; ++i)
+      this->add_word(word_list[i]);
+
+    // Debug dict
+    /*
+        for (auto s : m_words)
+          std::cout << s << "\n";
+
+        for (auto&& [k, v] : m_dic)
+        {
+          std::cout << k << " : ";
+          for (auto m : v)
+            std::cout << m << " " ;
+          std::cout << "\n";
+        }
+        std::cout << std::endl;
+    */
+  }
+
+
+  // Same index as DictionaryImplHashTable but the deletion keys are partitioned by hash into independent shards,
+  // each one guarded by a reader-writer lock. A writer (add_word) only blocks the shard it is inserting in, so
+  // lookups can proceed concurrently on the rest of the key space.
+  struct DictionaryImplSharded final : public DictionaryImplDeletionBase<DictionaryImplSharded>
+  {
+    explicit DictionaryImplSharded(const DictionaryOptions& options);
+
+    void load(std::string_view word_list[], std::size_t n) final;
+    void load(std::string_view word_list[], std::size_t n, int num_threads) final;
+
+    const char* insert(const char* new_word, match_info_t from);
+
+    template <class F>
+    bool lookup(const char* key, F&& visit) const
+    {
+      auto           hash  = string_hash{}(key);
+      const shard_t& shard = m_shards[hash % m_shards.size()];
+
+      // The loader already holds all the shards (it searches the index before keeping a word out of it)
+      std::shared_lock<std::shared_mutex> lock(shard.mutex, std::defer_lock);
+      if (m_loader.load(std::memory_order_relaxed) != std::this_thread::get_id())
+        lock.lock();
+
+      auto r = shard.dic.find(key);
+      if (r == shard.dic.end())
+        return false;
+      visit(r->second);
+      return true;
+    }
+
+    void collect_stats(IndexStats& s) const final;
+
+  private:
+    struct shard_t
+    {
+      mutable std::shared_mutex mutex;
+      dic_map_t                 dic;
+      std::deque<std::string>   words;
+    };
+
+    static const char* insert(shard_t& shard, const char* new_word, match_info_t from);
+
+    std::vector<shard_t>         m_shards;
+    std::atomic<std::thread::id> m_loader; // Thread holding all the shards during load (if any)
+  };
+
+
+  DictionaryImplSharded::DictionaryImplSharded(const DictionaryOptions& options)
+    : DictionaryImplDeletionBase(options)
+    , m_shards(options.num_shards)
+  {
+  }
+
+  const char* DictionaryImplSharded::insert(shard_t& shard, const char* new_word, match_info_t from)
+  {
+    const char* key;
+    matches_t*  matches;
+
+    if (auto r = shard.dic.find(new_word); r != shard.dic.end())
+    {
+      key     = r->first;
+      matches = &r->second;
+    }
+    else
+    {
+      shard.words.push_back(new_word);
+      key     = shard.words.back().c_str();
+      matches = &shard.dic[key];
+    }
+
+    if (from.get_word() == nullptr)
+      from.set_word(key);
+
+    matches->push_back(from);
+    return key;
+  }
+
+  const char* DictionaryImplSharded::insert(const char* new_word, match_info_t from)
+  {
+    auto     hash  = string_hash{}(new_word);
+    shard_t& shard = m_shards[hash % m_shards.size()];
+
+    if (m_loader.load(std::memory_order_relaxed) == std::this_thread::get_id())
+      return insert(shard, new_word, from);
+
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    return insert(shard, new_word, from);
+  }
+
+  void DictionaryImplSharded::collect_stats(IndexStats& s) const
+  {
+    for (const auto& shard : m_shards)
+    {
+      std::shared_lock<std::shared_mutex> lock(shard.mutex);
+      add_stats(shard.dic, shard.words, s);
+    }
+  }
+
+  void DictionaryImplSharded::load(std::string_view word_list[], std::size_t n)
+  {
+    // Take all the shards once for the whole build instead of locking per key
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    locks.reserve(m_shards.size());
+    for (auto& shard : m_shards)
+      locks.emplace_back(shard.mutex);
+
+    for (auto& shard : m_shards)
+    {
+      shard.dic.clear();
+      shard.words.clear();
+    }
+    this->reset(word_list, n);
+
+    m_loader = std::this_thread::get_id();
+    try
+    {
+      for (std::size_t i = 0; i < n; ++i)
+        this->add_word(word_list[i]);
+    }
+    catch (...)
+    {
+      m_loader = std::thread::id{};
+      throw;
+    }
+    m_loader = std::thread::id{};
+  }
+
+  void DictionaryImplSharded::load(std::string_view word_list[], std::size_t n, int num_threads)
+  {
+    if (num_threads <= 1)
+      return this->load(word_list, n);
+
+    this->load(word_list, 0);
+    this->reset(word_list, n); // Plan the memory budget for all the words
+
+    // Each thread inserts a contiguous range of words (with the per shard locks)
+    std::vector<std::thread> threads;
+    std::exception_ptr       error;
+    std::mutex               error_mutex;
+    for (int t = 0; t < num_threads; ++t)
+    {
+      threads.emplace_back([&, t] {
+        try
+        {
+          for (std::size_t i = n * t / num_threads; i < n * (t + 1) / num_threads; ++i)
+            this->add_word(word_list[i]);
+        }
+        catch (...)
+        {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (!error)
+            error = std::current_exception();
+        }
+      });
+    }
+    for (auto& t : threads)
+      t.join();
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+
+  // Same index as DictionaryImplHashTable, built in a hash table and frozen at the end of load: the keys are placed
+  // by a minimal perfect hash (see PerfectHash) in a flat table of slots, each one with a fingerprint of its key, and
+  // the postings are stored contiguously. A lookup reads one pilot and one slot, and a key not in the index (most of
+  // the deletions of a query) is rejected by the fingerprint without reading the key. The words can only be added
+  // by load (concurrent reads only).
+  struct DictionaryImplFrozen final : public DictionaryImplDeletionBase<DictionaryImplFrozen>
+  {
+    using DictionaryImplDeletionBase::DictionaryImplDeletionBase;
+
+    void load(std::string_view word_list[], std::size_t n) final;
+    void load(std::string_view word_list[], std::size_t n, int) final { this->load(word_list, n); }
+    void add_word(std::string_view word) final;
+
+    const char* insert(const char* new_word, match_info_t from);
+
+    template <class F>
+    bool lookup(const char* key, F&& visit) const
+    {
+      if (m_loading)
+      {
+        auto r = m_builder.find(key);
+        if (r == m_builder.end())
+          return false;
+        visit(r->second);
+        return true;
+      }
+
+      if (m_hash.size() == 0)
+        return false;
+      auto          h    = m_hash.hash(key);
+      const slot_t* slot = &m_slots[m_hash.position(h)];
+      if (slot->fingerprint != (std::uint32_t)(h >> 32) || std::strcmp(slot->key, key) != 0)
+        return false;
+      visit(postings_t{m_postings.data() + slot[0].first, m_postings.data() + slot[1].first});
+      return true;
+    }
+
+    void collect_stats(IndexStats& s) const final;
+
+  private:
+    struct slot_t
+    {
+      const char*   key         = nullptr;
+      std::uint32_t first       = 0; // The postings of the key end at the first one of the next slot
+      std::uint32_t fingerprint = 0; // High bits of the hash of the key
+    };
+
+    void freeze();
+
+    bool                      m_loading = false;
+    dic_map_t                 m_builder; // The index during load
+    std::deque<std::string>   m_words;
+    PerfectHash               m_hash;
+    std::vector<slot_t>       m_slots; // One per key, plus an end marker
+    std::vector<match_info_t> m_postings;
+  };
+
+  const char* DictionaryImplFrozen::insert(const char* new_word, match_info_t from)
+  {
+    const char* key;
+    matches_t*  matches;
+
+    if (auto r = m_builder.find(new_word); r != m_builder.end())
+    {
+      key     = r->first;
+      matches = &r->second;
+    }
+    else
+    {
+      m_words.push_back(new_word);
+      key     = m_words.back().c_str();
+      matches = &m_builder[key];
+    }
+
+    if (from.get_word() == nullptr)
+      from.set_word(key);
+
+    matches->push_back(from);
+    return key;
+  }
+
+  void DictionaryImplFrozen::add_word(std::string_view word)
+  {
+    if (!m_loading)
+      throw std::runtime_error("The Frozen backend does not support add_word (the words are added by load)");
+    DictionaryImplDeletionBase::add_word(word);
+  }
+
+  void DictionaryImplFrozen::load(std::string_view word_list[], std::size_t n)
+  {
+    m_builder.clear();
+    m_words.clear();
+    this->reset(word_list, n);
+
+    m_loading = true;
+    try
+    {
+      for (std::size_t i = 0; i < n; ++i)
+        this->add_word(word_list[i]);
+    }
+    catch (...)
+    {
+      this->freeze();
+      throw;
+    }
+    this->freeze();
+  }
+
+  void DictionaryImplFrozen::freeze()
+  {
+    m_loading = false;
+
+    // The nodes of the table are visited once
+    std::vector<std::string_view> keys;
+    std::vector<const matches_t*> lists;
+    keys.reserve(m_builder.size());
+    lists.reserve(m_builder.size());
+    for (const auto& [key, matches] : m_builder)
+    {
+      keys.push_back(key);
+      lists.push_back(&matches);
+    }
+    m_hash.build(keys);
+
+    // Place the keys and count their postings, then store the postings in the order of the slots
+    std::vector<std::uint32_t> positions(keys.size());
+    m_slots.assign(keys.size() + 1, slot_t{});
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+      auto h           = m_hash.hash(keys[i]);
+      positions[i]     = m_hash.position(h);
+      auto& slot       = m_slots[positions[i]];
+      slot.key         = keys[i].data();
+      slot.first       = (std::uint32_t)lists[i]->size();
+      slot.fingerprint = (std::uint32_t)(h >> 32);
+    }
+
+    std::size_t total = 0;
+    for (auto& slot : m_slots)
+    {
+      std::size_t n = slot.first;
+      slot.first    = (std::uint32_t)total;
+      total += n;
+    }
+    if (total > UINT32_MAX)
+      throw std::runtime_error("Too many postings for the Frozen backend");
+
+    m_postings.resize(total);
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      std::copy(lists[i]->begin(), lists[i]->end(), m_postings.begin() + m_slots[positions[i]].first);
+
+    dic_map_t{}.swap(m_builder);
+  }
+
+  void DictionaryImplFrozen::collect_stats(IndexStats& s) const
+  {
+    if (m_loading)
+      return add_stats(m_builder, m_words, s);
+
+    s.keys += m_hash.size();
+    s.buckets += m_hash.size();
+    s.table_bytes += m_slots.capacity() * sizeof(slot_t) + m_hash.bytes();
+    s.posting_bytes += m_postings.capacity() * sizeof(match_info_t);
+    const match_info_t* postings = m_postings.data();
+    for (std::size_t i = 0; i < m_hash.size(); ++i)
+      add_key_stats(m_slots[i].key, postings_t{postings + m_slots[i].first, postings + m_slots[i + 1].first}, s);
+    add_key_bytes(m_words, s);
+  }
+
+
+  // The words in a compact trie searched with a bounded Levenshtein matrix (see CompactTrie): about the size of the
+  // word list itself, where the deletion index stores O(length^2) keys per word, at the cost of slower queries
+  // (concurrent reads only). Edits are counted in bytes.
+  struct DictionaryImplTrie final : public DictionaryImplCommon
+  {
+    explicit DictionaryImplTrie(const DictionaryOptions& options);
+
+    void load(std::string_view word_list[], std::size_t n) final;
+    void load(std::string_view word_list[], std::size_t n, int) final { this->load(word_list, n); }
+
+  protected:
+    const char* insert_word(char buffer[], int len) final { return m_trie.insert({buffer, (std::size_t)len}); }
+    void        search(const search_context_t& ctx, DictionaryMatch& best_match) const final;
+    void        collect_stats(IndexStats& s) const final;
+    double      projected_bytes(int len) const final { return trie_bytes(len); }
+
+  private:
+    CompactTrie m_trie;
+  };
+
+  DictionaryImplTrie::DictionaryImplTrie(const DictionaryOptions& options)
+    : DictionaryImplCommon(options)
+  {
+    if (options.utf8)
+      throw std::runtime_error("The Trie backend does not support utf8");
+  }
+
+  void DictionaryImplTrie::load(std::string_view word_list[], std::size_t n)
+  {
+    m_trie.clear();
+    this->reset(word_list, n);
+
+    for (std::size_t i = 0; i < n; ++i)
+      this->add_word(word_list[i]);
+  }
+
+  // Each word is reached once, so the ties need no deduplication. Unless the ties are counted, the bound is
+  // lowered below the best distance found.
+  void DictionaryImplTrie::search(const search_context_t& ctx, DictionaryMatch& best_match) const
+  {
+    m_trie.search(ctx.word, ctx.max_score, ctx.transpositions, [&](const char* word, int d) {
+      FSC_COUNT(postings);
+      if (ctx.candidates != nullptr)
+      {
+        ctx.candidates->push_back({word, d});
+        return ctx.max_score;
+      }
+
+      if (d < best_match.distance)
+      {
+        best_match.distance = d;
+        best_match.word     = word;
+        best_match.count    = 1;
+        if (ctx.ties)
+          ctx.ties->assign(1, word);
+      }
+      else if (d == best_match.distance)
+      {
+        // The caller counts the ties of the trie and of the unindexed words together
+        if (ctx.ties)
+          ctx.ties->push_back(word);
+        else
+          best_match.count += 1;
+      }
+
+      if (ctx.stop_first_found)
+        return -1;
+      return ctx.exact_count ? d : d - 1;
+    });
+  }
+
+  // The nodes are reported as the keys (table_bytes) and the words as their strings (key_bytes)
+  void DictionaryImplTrie::collect_stats(IndexStats& s) const
+  {
+    s.words       = m_trie.size();
+    s.keys        = m_trie.num_nodes();
+    s.table_bytes = m_trie.node_bytes();
+    s.key_bytes   = m_trie.word_bytes();
+  }
+
+
+  // Estimated memory of the indexes of a word list
+  struct load_estimate_t
+  {
+    double deletion_bytes; // HashTable or Sharded
+    double long_words;     // Fraction of the words of kLongWordLength bytes or more
+  };
+
+  load_estimate_t estimate_load(const std::string_view words[], std::size_t n)
+  {
+    load_estimate_t e = {0, 0};
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      int len = words[i].size();
+      e.deletion_bytes += deletion_index_bytes(len);
+      e.long_words += len >= kLongWordLength;
+    }
+    if (n > 0)
+      e.long_words /= n;
+    return e;
+  }
+
+  // The deletion index is the fastest unless:
+  // * it does not fit in the memory budget: the trie is an order of magnitude smaller
+  // * the words are mostly long and the queries are at distance <= 1: the trie is then as fast (the deletion
+  //   index enumerates O(length) deletions of the query, the trie walks a band of 3 cells per node)
+  // The trie does not support utf8.
+  DictionaryBackend choose_backend(const std::string_view words[], std::size_t n, const DictionaryOptions& options)
+  {
+    if (options.utf8)
+      return DictionaryBackend::HashTable;
+
+    auto e = estimate_load(words, n);
+    if (options.memory_budget > 0 && e.deletion_bytes > options.memory_budget)
+      return DictionaryBackend::Trie;
+    if (options.max_distance <= 1 && e.long_words >= 0.5)
+      return DictionaryBackend::Trie;
+    return DictionaryBackend::HashTable;
+  }
+
+} // namespace
+
+Dictionary::Dictionary()
+  : Dictionary(DictionaryOptions{})
+{
+}
+
+Dictionary::Dictionary(const DictionaryOptions& options)
+  : m_options(options)
+{
+  // Auto starts with an empty hash table (for add_word before load)
+  create_impl(options.backend == DictionaryBackend::Auto ? DictionaryBackend::HashTable : options.backend);
+
+  if (options.latency_histograms || (options.on_slow_query && options.slow_query_ns > 0))
+    m_impl->latency = std::make_unique<LatencyRecorder>(options);
+}
+
+void Dictionary::create_impl(DictionaryBackend backend)
+{
+  std::unique_ptr<DictionaryImplBase> impl;
+  switch (backend)
+  {
+  case DictionaryBackend::HashTable:
+    impl = std::make_unique<DictionaryImplHashTable>(m_options);
+    break;
+  case DictionaryBackend::Sharded:
+    if (m_options.num_shards <= 0)
+      throw std::runtime_error("Invalid number of shards (Must be > 0)");
+    impl = std::make_unique<DictionaryImplSharded>(m_options);
+    break;
+  case DictionaryBackend::Trie:
+    impl = std::make_unique<DictionaryImplTrie>(m_options);
+    break;
+  case DictionaryBackend::Frozen:
+    impl = std::make_unique<DictionaryImplFrozen>(m_options);
+    break;
+  default:
+    throw std::runtime_error("Unknown dictionary backend");
+  }
+
+  // The latency histograms outlive a change of backend
+  if (m_impl)
+    impl->latency = std::move(m_impl->latency);
+  m_impl    = std::move(impl);
+  m_backend = backend;
+}
+
+void Dictionary::select_backend(const std::string_view word_list[], std::size_t n)
+{
+  if (m_options.backend != DictionaryBackend::Auto)
+    return;
+
+  auto backend = choose_backend(word_list, n, m_options);
+  if (backend != m_backend)
+    create_impl(backend);
+}
+
+DictionaryBackend Dictionary::backend() const noexcept
+{
+  return m_backend;
+}
+
+
+Dictionary::~Dictionary()
+{
+}
+
+
+void Dictionary::load(std::string_view word_list[], std::size_t n)
+{
+  select_backend(word_list, n);
+  m_impl->load(word_list, n);
+}
+
+void Dictionary::load_file(const std::string& path, int num_threads)
+{
+  MappedFile file(path);
+  auto       words = split_lines(file.data(), num_threads);
+  remove_duplicates(words);
+  select_backend(words.data(), words.size());
+  m_impl->load(words.data(), words.size(), num_threads);
+}
+
+void Dictionary::add_word(std::string_view word)
+{
+  m_impl->add_word(word);
+}
+
+
+namespace
+{
+  void check_params(std::string_view word, int d)
+  {
+    if (d > kMaxDist)
+      throw std::runtime_error("Invalid distance (Must be <= 2)");
+
+    if (word.size() > kMaxWordLength)
+      throw std::runtime_error("Word too long (should be <= 255)");
+  }
+
+  // Run the query, timed if the instrumentation is enabled
+  template <class F>
+  auto timed(LatencyRecorder* latency, std::string_view word, int d, const char* kind, F&& query)
+  {
+    if (latency == nullptr)
+      return query();
+
+    auto start  = LatencyRecorder::clock::now();
+    auto result = query();
+    latency->record(word, d, kind, start);
+    return result;
+  }
+}
+
+
+bool Dictionary::has_matches(std::string_view word, int d)
+{
+  check_params(word, d);
+  [[maybe_unused]] query_scope scope;
+  return timed(m_impl->latency.get(), word, d, "has_matches", [&] { return m_impl->has_matches(word, d); });
+}
+
+
+
+int Dictionary::max_word_length() const noexcept
+{
+  return kMaxWordLength;
+}
+
+int Dictionary::longest_word_length() const noexcept
+{
+  return m_impl->longest_word_length();
+}
+
+std::size_t Dictionary::num_words() const
+{
+  return m_impl->num_words();
+}
+
+std::uint32_t Dictionary::word_id(const char* word) const
+{
+  return word ? m_impl->word_id(word) : kNoWord;
+}
+
+const char* Dictionary::word(std::uint32_t id) const
+{
+  return m_impl->word(id);
+}
+
+CacheStats Dictionary::cache_stats() const
+{
+  return m_impl->cache_stats();
+}
+
+CacheStats Dictionary::negative_cache_stats() const
+{
+  return m_impl->negative_cache_stats();
+}
+
+IndexStats Dictionary::stats() const
+{
+  return m_impl->stats();
+}
+
+std::vector<std::string> Dictionary::downgraded_words() const
+{
+  return m_impl->downgraded_words();
+}
+
+LatencyHistogram Dictionary::latency_histogram(int d, int length_class) const
+{
+  if (d < 0 || d > kMaxDist || length_class < 0 || length_class >= kNumLengthClasses)
+    throw std::runtime_error("Invalid latency histogram (distance or length class out of range)");
+  return m_impl->latency ? m_impl->latency->histogram(d, length_class) : LatencyHistogram{};
+}
+
+void Dictionary::reset_latency_histograms()
+{
+  if (m_impl->latency)
+    m_impl->latency->reset();
+}
+
+
+DictionaryMatch Dictionary::best_match(std::string_view word, int d)
+{
+  check_params(word, d);
+  [[maybe_unused]] query_scope scope;
+  return timed(m_impl->latency.get(), word, d, "best_match", [&] { return m_impl->best_match(word, d); });
+}
+
+
+std::vector<DictionaryMatch> Dictionary::candidates(std::string_view word, int d)
+{
   check_params(word, d);
-  return m_impl->best_match(word, d);
+  [[maybe_unused]] query_scope scope;
+  return timed(m_impl->latency.get(), word, d, "candidates", [&] { return m_impl->candidates(word, d); });
+}
+
+
+int edit_distance(std::string_view a, std::string_view b, bool transpositions, bool utf8)
+{
+  if (a.size() > kMaxWordLength || b.size() > kMaxWordLength)
+    throw std::runtime_error("Word too long (should be <= 255)");
+
+  if (!utf8)
+    return bounded_distance(a.data(), a.size(), b.data(), b.size(), kMaxWordLength, transpositions);
+
+  char32_t ua[kMaxWordLength + 1];
+  char32_t ub[kMaxWordLength + 1];
+  int      n = utf8_decode(a, ua);
+  int      m = utf8_decode(b, ub);
+  return bounded_distance(ua, n, ub, m, kMaxWordLength, transpositions);
+}
+
+
+QueryCounters& QueryCounters::operator+=(const QueryCounters& other)
+{
+  queries += other.queries;
+  variants += other.variants;
+  key_hits += other.key_hits;
+  postings += other.postings;
+  distance_calls += other.distance_calls;
+  early_exits += other.early_exits;
+  return *this;
+}
+
+bool query_counters_enabled() noexcept
+{
+#ifdef FSC_QUERY_COUNTERS
+  return true;
+#else
+  return false;
+#endif
+}
+
+QueryCounters last_query_counters() noexcept
+{
+#ifdef FSC_QUERY_COUNTERS
+  return tl_last_query;
+#else
+  return {};
+#endif
+}
+
+QueryCounters thread_query_counters() noexcept
+{
+#ifdef FSC_QUERY_COUNTERS
+  return tl_thread_total;
+#else
+  return {};
+#endif
+}
+
+void reset_thread_query_counters() noexcept
+{
+#ifdef FSC_QUERY_COUNTERS
+  tl_thread_total = {};
+#endif
 }
 
 
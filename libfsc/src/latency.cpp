@@ -0,0 +1,122 @@
+#include "latency.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+
+namespace
+{
+  constexpr int kSubBits    = 3; // 8 sub-buckets per power of 2
+  constexpr int kSubBuckets = 1 << kSubBits;
+}
+
+
+int LatencyHistogram::bucket_of(std::uint64_t ns)
+{
+  if (ns < kSubBuckets)
+    return (int)ns;
+
+  int e = kSubBits; // Index of the highest bit
+  while ((ns >> (e + 1)) != 0)
+    ++e;
+  int sub = (int)(ns >> (e - kSubBits)) & (kSubBuckets - 1);
+  return (e - kSubBits + 1) * kSubBuckets + sub;
+}
+
+std::uint64_t LatencyHistogram::bucket_upper_bound(int b)
+{
+  if (b < kSubBuckets)
+    return b;
+  if (b >= kNumBuckets - 1)
+    return UINT64_MAX;
+
+  // Lower bound of the next bucket - 1
+  int e   = (b + 1) / kSubBuckets + kSubBits - 1;
+  int sub = (b + 1) % kSubBuckets;
+  return ((std::uint64_t)(kSubBuckets + sub) << (e - kSubBits)) - 1;
+}
+
+std::uint64_t LatencyHistogram::count() const
+{
+  std::uint64_t n = 0;
+  for (auto c : counts)
+    n += c;
+  return n;
+}
+
+std::uint64_t LatencyHistogram::percentile(double p) const
+{
+  auto n = count();
+  if (n == 0)
+    return 0;
+
+  auto rank = (std::uint64_t)std::ceil(std::clamp(p, 0.0, 100.0) / 100.0 * n);
+  rank      = std::max<std::uint64_t>(rank, 1);
+
+  std::uint64_t seen = 0;
+  for (int b = 0; b < (int)counts.size(); ++b)
+  {
+    seen += counts[b];
+    if (seen >= rank)
+      return bucket_upper_bound(b);
+  }
+  return bucket_upper_bound(kNumBuckets - 1);
+}
+
+int length_class(std::size_t n)
+{
+  int c = 0;
+  for (std::size_t bound = 4; c < kNumLengthClasses - 1 && n >= bound; bound *= 2)
+    ++c;
+  return c;
+}
+
+
+LatencyRecorder::LatencyRecorder(const DictionaryOptions& options)
+  : m_histograms{options.latency_histograms}
+  , m_slow_query_ns{options.slow_query_ns}
+  , m_on_slow_query{options.on_slow_query}
+{
+  if (m_histograms)
+    m_buckets = std::make_unique<histogram_t[]>(kNumDistances * kNumLengthClasses);
+  reset();
+}
+
+void LatencyRecorder::record(std::string_view word, int d, const char* kind, clock::time_point start)
+{
+  auto ns = (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+
+  if (m_histograms && d >= 0 && d < kNumDistances)
+  {
+    auto& h = m_buckets[d * kNumLengthClasses + length_class(word.size())];
+    h[LatencyHistogram::bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (m_on_slow_query && m_slow_query_ns > 0 && ns >= m_slow_query_ns)
+    m_on_slow_query(SlowQuery{word, d, kind, ns, last_query_counters()});
+}
+
+LatencyHistogram LatencyRecorder::histogram(int d, int length_class) const
+{
+  assert(d >= 0 && d < kNumDistances && length_class >= 0 && length_class < kNumLengthClasses);
+
+  LatencyHistogram result;
+  if (!m_histograms)
+    return result;
+
+  auto& h = m_buckets[d * kNumLengthClasses + length_class];
+  result.counts.resize(LatencyHistogram::kNumBuckets);
+  for (int b = 0; b < LatencyHistogram::kNumBuckets; ++b)
+    result.counts[b] = h[b].load(std::memory_order_relaxed);
+  return result;
+}
+
+void LatencyRecorder::reset()
+{
+  if (!m_histograms)
+    return;
+  for (int i = 0; i < kNumDistances * kNumLengthClasses; ++i)
+    for (auto& c : m_buckets[i])
+      c.store(0, std::memory_order_relaxed);
+}
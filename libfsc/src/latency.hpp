@@ -0,0 +1,34 @@
+#pragma once
+
+#include <fsc.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+
+/// Latency histograms of the queries (by distance and class of query length) and the slow query hook.
+///
+/// The buckets are relaxed atomic counters, so concurrent queries record without locking.
+class LatencyRecorder
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  explicit LatencyRecorder(const DictionaryOptions& options);
+
+  void record(std::string_view word, int d, const char* kind, clock::time_point start);
+
+  LatencyHistogram histogram(int d, int length_class) const;
+  void             reset();
+
+private:
+  static constexpr int kNumDistances = 3;
+  using histogram_t = std::atomic<std::uint64_t>[LatencyHistogram::kNumBuckets];
+
+  bool                                  m_histograms;
+  std::uint64_t                         m_slow_query_ns;
+  std::function<void(const SlowQuery&)> m_on_slow_query;
+  std::unique_ptr<histogram_t[]>        m_buckets; // [d * kNumLengthClasses + length class]
+};
@@ -0,0 +1,149 @@
+#include <fsc.hpp>
+
+#include <cstdint>
+#include <cstring>
+
+
+namespace
+{
+  // Base letter of the Latin-1 characters 0xC0-0xFF ('.' when the character is kept)
+  constexpr char kLatin1Base[] = "AAAAAA.CEEEEIIII"
+                                 "DNOOOOO.OUUUUY.."
+                                 "aaaaaa.ceeeeiiii"
+                                 "dnooooo.ouuuuy.y";
+
+  // Base letter of the Latin Extended-A characters U+0100-U+017F ('.' when the character is kept)
+  constexpr char kLatinExtABase[] = "AaAaAaCcCcCcCcDd"
+                                    "DdEeEeEeEeEeGgGg"
+                                    "GgGgHhHhIiIiIiIi"
+                                    "Ii..JjKk.LlLlLlL"
+                                    "lLlNnNnNn...OoOo"
+                                    "Oo..RrRrRrSsSsSs"
+                                    "SsTtTtTtUuUuUuUu"
+                                    "UuUuWwYyYZzZzZzs";
+
+  constexpr std::uint64_t kOnes = 0x0101010101010101ull;
+  constexpr std::uint64_t kHigh = 0x8080808080808080ull;
+
+  // Lowercase the ASCII letters of 8 packed bytes (other bytes are left untouched)
+  inline std::uint64_t ascii_tolower8(std::uint64_t x)
+  {
+    std::uint64_t heptets  = x & ~kHigh;
+    std::uint64_t gt_Z     = heptets + (0x7F - 'Z') * kOnes; // High bit set if > 'Z'
+    std::uint64_t ge_A     = heptets + (0x80 - 'A') * kOnes; // High bit set if >= 'A'
+    std::uint64_t is_upper = ~x & (ge_A ^ gt_Z) & kHigh;
+    return x | (is_upper >> 2);
+  }
+
+  void ascii_tolower(char* s, std::size_t n)
+  {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      std::uint64_t x;
+      std::memcpy(&x, s + i, 8);
+      x = ascii_tolower8(x);
+      std::memcpy(s + i, &x, 8);
+    }
+    for (; i < n; ++i)
+      if (s[i] >= 'A' && s[i] <= 'Z')
+        s[i] += 'a' - 'A';
+  }
+
+  inline bool is_space(char c)
+  {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+  }
+
+  // Strip the accents in place, returns the new length (never larger)
+  std::size_t strip_accents(char* s, std::size_t n, bool utf8)
+  {
+    std::size_t j = 0;
+    for (std::size_t i = 0; i < n;)
+    {
+      auto c = (unsigned char)s[i];
+
+      if (c < 0x80)
+      {
+        s[j++] = s[i++];
+        continue;
+      }
+
+      if (!utf8)
+      {
+        char base = (c >= 0xC0) ? kLatin1Base[c - 0xC0] : '.';
+        s[j++]    = (base != '.') ? base : s[i];
+        i++;
+        continue;
+      }
+
+      if (c >= 0xC3 && c <= 0xCD && i + 1 < n && ((unsigned char)s[i + 1] & 0xC0) == 0x80)
+      {
+        int  cp   = ((c & 0x1F) << 6) | (s[i + 1] & 0x3F);
+        char base = '.';
+        if (cp >= 0xC0 && cp < 0x100)
+          base = kLatin1Base[cp - 0xC0];
+        else if (cp >= 0x100 && cp < 0x180)
+          base = kLatinExtABase[cp - 0x100];
+        else if (cp >= 0x300 && cp < 0x370) // Combining diacritical marks are dropped
+        {
+          i += 2;
+          continue;
+        }
+
+        if (base != '.')
+        {
+          s[j++] = base;
+          i += 2;
+          continue;
+        }
+      }
+      s[j++] = s[i++];
+    }
+    return j;
+  }
+} // namespace
+
+
+std::size_t normalize(std::string_view word, char out[], Normalization flags, bool utf8)
+{
+  std::size_t n = word.size();
+  std::memcpy(out, word.data(), n);
+
+  if (any(flags & Normalization::StripAccents))
+    n = strip_accents(out, n, utf8);
+
+  if (any(flags & Normalization::Lowercase))
+    ascii_tolower(out, n);
+
+  if (any(flags & Normalization::Hyphens))
+    for (std::size_t i = 0; i < n; ++i)
+      if (out[i] == '-' || out[i] == '_')
+        out[i] = ' ';
+
+  if (any(flags & Normalization::Whitespace))
+  {
+    // Collapse the runs of blanks into a single space and trim
+    std::size_t j     = 0;
+    bool        blank = true;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      if (!is_space(out[i]))
+        out[j++] = out[i];
+      else if (!blank)
+        out[j++] = ' ';
+      blank = is_space(out[i]);
+    }
+    if (j > 0 && out[j - 1] == ' ')
+      j--;
+    n = j;
+  }
+  return n;
+}
+
+std::string normalize(std::string_view word, Normalization flags, bool utf8)
+{
+  std::string out(word.size(), '\0');
+  out.resize(normalize(word, out.data(), flags, utf8));
+  return out;
+}
@@ -0,0 +1,130 @@
+#include "perfect_hash.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+
+namespace
+{
+  constexpr double        kBucketsPerKey = 7.0;     // Buckets: 7 n / log2(n)
+  constexpr std::uint32_t kMaxPilot      = 1 << 24; // Beyond, the build is retried with another seed
+  constexpr int           kMaxAttempts   = 16;
+}
+
+
+void PerfectHash::clear()
+{
+  m_size = m_table_size = m_num_buckets = m_dense_buckets = 0;
+  m_pilots.clear();
+  m_remap.clear();
+}
+
+void PerfectHash::build(const std::vector<std::string_view>& keys)
+{
+  if (keys.size() >= UINT32_MAX / 2)
+    throw std::runtime_error("Too many keys for the perfect hash");
+
+  std::vector<std::uint64_t> hashes(keys.size());
+  for (int attempt = 0; attempt < kMaxAttempts; ++attempt)
+  {
+    m_seed = std::uint64_t(attempt) * kMul;
+    for (std::size_t i = 0; i < keys.size(); ++i)
+      hashes[i] = hash_bytes(keys[i], m_seed);
+    if (try_build(hashes))
+      return;
+  }
+  clear();
+  throw std::runtime_error("Cannot build the perfect hash (duplicate keys)");
+}
+
+bool PerfectHash::try_build(const std::vector<std::uint64_t>& hashes)
+{
+  auto n = (std::uint32_t)hashes.size();
+
+  m_size          = n;
+  m_table_size    = n + n / 50; // Load factor 0.98
+  m_num_buckets   = std::max<std::uint32_t>(1, (std::uint32_t)std::ceil(kBucketsPerKey * n / std::log2(n + 2)));
+  m_dense_buckets = m_num_buckets * 3 / 10;
+  m_pilots.assign(m_num_buckets, 0);
+  m_remap.assign(m_table_size - n, 0);
+  if (n == 0)
+    return true;
+
+  // Group the hashes (the part the position depends on) by bucket
+  std::vector<std::uint32_t> offsets(m_num_buckets + 1, 0);
+  std::vector<std::uint32_t> buckets(n);
+  for (std::uint32_t i = 0; i < n; ++i)
+  {
+    buckets[i] = bucket(hashes[i], mix(hashes[i]));
+    offsets[buckets[i] + 1]++;
+  }
+  for (std::uint32_t b = 0; b < m_num_buckets; ++b)
+    offsets[b + 1] += offsets[b];
+
+  std::vector<std::uint32_t> grouped(n);
+  {
+    std::vector<std::uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (std::uint32_t i = 0; i < n; ++i)
+      grouped[cursor[buckets[i]]++] = (std::uint32_t)mix(hashes[i]);
+  }
+
+  // Largest buckets first (the table is almost empty when they are placed)
+  std::vector<std::uint32_t> order(m_num_buckets);
+  for (std::uint32_t b = 0; b < m_num_buckets; ++b)
+    order[b] = b;
+  std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+    return offsets[a + 1] - offsets[a] > offsets[b + 1] - offsets[b];
+  });
+
+  std::vector<bool>          taken(m_table_size, false);
+  std::vector<std::uint32_t> positions;
+  for (std::uint32_t b : order)
+  {
+    auto first = grouped.begin() + offsets[b];
+    auto last  = grouped.begin() + offsets[b + 1];
+    if (first == last)
+      break;
+
+    // Two keys of a bucket with the same hash always collide
+    std::sort(first, last);
+    if (std::adjacent_find(first, last) != last)
+      return false;
+
+    for (std::uint32_t pilot = 0;; ++pilot)
+    {
+      if (pilot == kMaxPilot)
+        return false;
+
+      auto ph = pilot_hash(pilot);
+      positions.clear();
+      for (auto it = first; it != last; ++it)
+      {
+        auto pos = reduce(*it ^ ph, m_table_size);
+        if (taken[pos] || std::find(positions.begin(), positions.end(), pos) != positions.end())
+          break;
+        positions.push_back(pos);
+      }
+      if (positions.size() == std::size_t(last - first))
+      {
+        for (auto pos : positions)
+          taken[pos] = true;
+        m_pilots[b] = pilot;
+        break;
+      }
+    }
+  }
+
+  // The keys placed beyond n go to the free slots below n
+  std::uint32_t free_slot = 0;
+  for (std::uint32_t pos = n; pos < m_table_size; ++pos)
+  {
+    if (!taken[pos])
+      continue;
+    while (taken[free_slot])
+      ++free_slot;
+    m_remap[pos - n] = free_slot++;
+  }
+  return true;
+}
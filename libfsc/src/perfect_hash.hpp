@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+
+/// Minimal perfect hash function of a static set of distinct keys (PTHash-like): the n keys get distinct
+/// positions in [0, n).
+///
+/// The keys are spread in buckets (60% of them in 30% of the buckets) and each bucket gets a pilot, chosen at build
+/// from the largest buckets to the smallest, such that the positions of its keys, hash(key) ^ hash(pilot), hit free
+/// slots of a table of n / 0.98 slots. The positions beyond n are then remapped to the free slots below n. A query
+/// is one pilot read and a few multiplications, 1 to 2 bytes per key.
+///
+/// A key not in the set gets an arbitrary position: the caller has to check the key found there.
+class PerfectHash
+{
+public:
+  /// Build the function of a set of keys (throws if they are not distinct)
+  void build(const std::vector<std::string_view>& keys);
+  void clear();
+
+  std::size_t size() const { return m_size; }
+  std::size_t bytes() const { return (m_pilots.capacity() + m_remap.capacity()) * sizeof(std::uint32_t); }
+
+  /// 64-bit hash of a key (the position is derived from it, the high bits are free for a fingerprint)
+  std::uint64_t hash(std::string_view key) const { return hash_bytes(key, m_seed); }
+
+  /// The position of the key of a hash (size() must be > 0)
+  std::uint32_t position(std::uint64_t h) const
+  {
+    std::uint64_t g   = mix(h);
+    std::uint32_t pos = reduce((std::uint32_t)g ^ pilot_hash(m_pilots[bucket(h, g)]), m_table_size);
+    return pos < m_size ? pos : m_remap[pos - m_size];
+  }
+
+private:
+  static constexpr std::uint64_t kMul = 0x9e3779b97f4a7c15ULL;
+
+  // Finalizer of splitmix64
+  static std::uint64_t mix(std::uint64_t x)
+  {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  // Map x uniformly to [0, n) without a division
+  static std::uint32_t reduce(std::uint32_t x, std::uint32_t n) { return (std::uint32_t)(((std::uint64_t)x * n) >> 32); }
+
+  static std::uint32_t pilot_hash(std::uint32_t pilot) { return (std::uint32_t)mix(pilot + kMul); }
+
+  static std::uint64_t hash_bytes(std::string_view key, std::uint64_t seed)
+  {
+    const char*   p = key.data();
+    std::size_t   n = key.size();
+    std::uint64_t h = seed ^ (n * kMul);
+    for (; n >= 8; p += 8, n -= 8)
+    {
+      std::uint64_t k;
+      std::memcpy(&k, p, 8);
+      h = ((h ^ (k * kMul)) << 31 | (h ^ (k * kMul)) >> 33) * 0xc2b2ae3d27d4eb4fULL;
+    }
+    if (n > 0)
+    {
+      std::uint64_t k = 0;
+      std::memcpy(&k, p, n);
+      h ^= k * kMul;
+    }
+    return mix(h);
+  }
+
+  std::uint32_t bucket(std::uint64_t h, std::uint64_t g) const
+  {
+    // 60% of the keys in the first 30% of the buckets
+    if ((std::uint32_t)(g >> 32) < 2576980377u)
+      return reduce((std::uint32_t)h, m_dense_buckets);
+    return m_dense_buckets + reduce((std::uint32_t)h, m_num_buckets - m_dense_buckets);
+  }
+
+  bool try_build(const std::vector<std::uint64_t>& hashes);
+
+  std::uint64_t              m_seed          = 0;
+  std::uint32_t              m_size          = 0;
+  std::uint32_t              m_table_size    = 0;
+  std::uint32_t              m_num_buckets   = 0;
+  std::uint32_t              m_dense_buckets = 0;
+  std::vector<std::uint32_t> m_pilots;
+  std::vector<std::uint32_t> m_remap; // Slot (< size) of the positions >= size
+};
@@ -0,0 +1,215 @@
+#include <fsc_phrase.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+
+
+namespace
+{
+  constexpr int kNoMatch = INT_MAX / 4; // Distance of the tokens too long to be compared
+
+  // Tokens of 255 bytes at most are compared (see edit_distance)
+  constexpr std::size_t kMaxTokenLength = 255;
+
+  // The token dictionary works on the normalized tokens
+  DictionaryOptions token_options(DictionaryOptions options)
+  {
+    if (options.backend == DictionaryBackend::Frozen)
+      throw std::runtime_error("The Frozen backend does not support add_phrase");
+    options.normalization = Normalization::None;
+    options.edit_costs    = nullptr;
+    return options;
+  }
+
+  std::vector<std::string> pairs_of(const std::vector<std::string>& tokens)
+  {
+    std::vector<std::string> pairs;
+    for (std::size_t i = 0; i + 1 < tokens.size(); ++i)
+      pairs.push_back(tokens[i] + tokens[i + 1]);
+    return pairs;
+  }
+
+  // Length in characters (code points in utf8 mode)
+  int length_of(std::string_view token, bool utf8)
+  {
+    if (!utf8)
+      return token.size();
+    int n = 0;
+    for (char c : token)
+      n += ((unsigned char)c & 0xC0) != 0x80;
+    return n;
+  }
+}
+
+
+PhraseMatcher::PhraseMatcher(const DictionaryOptions& options)
+  : m_options{options}
+  , m_tokens{token_options(options)}
+{
+}
+
+
+std::vector<std::string> PhraseMatcher::tokenize(std::string_view phrase) const
+{
+  std::string normalized = any(m_options.normalization)
+                               ? normalize(phrase, m_options.normalization | Normalization::Whitespace,
+                                           m_options.utf8 || m_options.utf8_normalization)
+                               : normalize(phrase, Normalization::Whitespace);
+
+  std::vector<std::string> tokens;
+  std::size_t              start = 0;
+  while (start < normalized.size())
+  {
+    auto end = std::min(normalized.find(' ', start), normalized.size());
+    tokens.push_back(normalized.substr(start, end - start));
+    start = end + 1;
+  }
+  return tokens;
+}
+
+
+int PhraseMatcher::distance(std::string_view a, std::string_view b) const
+{
+  // A missing or extra token costs its length
+  if (a.empty() || b.empty())
+    return length_of(a.empty() ? b : a, m_options.utf8);
+  if (a.size() > kMaxTokenLength || b.size() > kMaxTokenLength)
+    return kNoMatch;
+  return edit_distance(a, b, m_options.transpositions, m_options.utf8);
+}
+
+
+void PhraseMatcher::add_token(std::string token, posting_t p)
+{
+  if (token.size() >= (std::size_t)m_tokens.max_word_length())
+    return;
+
+  auto r = m_postings.find(token);
+  if (r == m_postings.end())
+  {
+    m_tokens.add_word(token);
+    m_token_words.push_back(std::move(token));
+    r = m_postings.emplace(m_token_words.back(), std::vector<posting_t>{}).first;
+  }
+  r->second.push_back(p);
+}
+
+
+void PhraseMatcher::add_phrase(std::string_view phrase)
+{
+  phrase_t entry;
+  entry.original = phrase;
+  entry.tokens   = this->tokenize(phrase);
+  entry.pairs    = pairs_of(entry.tokens);
+
+  int id = m_phrases.size();
+  int n  = entry.tokens.size();
+  for (int i = 0; i < n; ++i)
+  {
+    this->add_token(entry.tokens[i], {id, i});
+    if (i + 1 < n)
+      this->add_token(entry.pairs[i], {id, i});
+  }
+  m_phrases.push_back(std::move(entry));
+}
+
+
+void PhraseMatcher::load(std::string_view phrases[], std::size_t n)
+{
+  m_tokens.load(nullptr, 0);
+  m_token_words.clear();
+  m_postings.clear();
+  m_phrases.clear();
+
+  for (std::size_t i = 0; i < n; ++i)
+    this->add_phrase(phrases[i]);
+}
+
+
+int PhraseMatcher::score(const std::vector<std::string>& query, const std::vector<std::string>& query_pairs,
+                         const phrase_t& entry) const
+{
+  const auto& tokens = entry.tokens;
+  int         n      = query.size();
+  int         m      = tokens.size();
+
+  // D[i][j]: score of the alignment of the i first query tokens with the j first entry tokens
+  std::vector<int> D((n + 1) * (m + 1), INT_MAX / 2);
+  auto             at = [&](int i, int j) -> int& { return D[i * (m + 1) + j]; };
+
+  at(0, 0) = 0;
+  for (int i = 0; i <= n; ++i)
+  {
+    for (int j = 0; j <= m; ++j)
+    {
+      int& v = at(i, j);
+      if (i > 0)
+        v = std::min(v, at(i - 1, j) + distance(query[i - 1], "") + 1);
+      if (j > 0)
+        v = std::min(v, at(i, j - 1) + distance("", tokens[j - 1]) + 1);
+      if (i > 0 && j > 0)
+        v = std::min(v, at(i - 1, j - 1) + distance(query[i - 1], tokens[j - 1]));
+      if (i > 0 && j > 1)
+        v = std::min(v, at(i - 1, j - 2) + distance(query[i - 1], entry.pairs[j - 2]) + 1);
+      if (i > 1 && j > 0)
+        v = std::min(v, at(i - 2, j - 1) + distance(query_pairs[i - 2], tokens[j - 1]) + 1);
+    }
+  }
+  return at(n, m);
+}
+
+
+DictionaryMatch PhraseMatcher::best_match(std::string_view phrase, int d, int max_distance)
+{
+  DictionaryMatch best;
+  best.word              = nullptr;
+  best.distance          = INT_MAX;
+  best.count             = 0;
+  best.weighted_distance = INFINITY;
+
+  auto query       = this->tokenize(phrase);
+  auto query_pairs = pairs_of(query);
+
+  // Entries sharing (approximately) a token or a pair of merged tokens with the query
+  std::vector<int> candidates;
+  auto             lookup = [&](const std::string& item) {
+    if (item.size() > (std::size_t)m_tokens.max_word_length())
+      return;
+    for (const auto& c : m_tokens.candidates(item, d))
+      for (auto p : m_postings.at(c.word))
+        candidates.push_back(p.phrase);
+  };
+
+  for (std::size_t i = 0; i < query.size(); ++i)
+  {
+    lookup(query[i]);
+    if (i + 1 < query.size())
+      lookup(query_pairs[i]);
+  }
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+  for (int id : candidates)
+  {
+    int s = this->score(query, query_pairs, m_phrases[id]);
+    if (s > max_distance)
+      continue;
+
+    if (s < best.distance)
+    {
+      best.distance = s;
+      best.word     = m_phrases[id].original.c_str();
+      best.count    = 1;
+    }
+    else if (s == best.distance)
+    {
+      best.count += 1;
+    }
+  }
+
+  if (best.word != nullptr)
+    best.weighted_distance = best.distance;
+  return best;
+}
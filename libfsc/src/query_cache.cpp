@@ -0,0 +1,228 @@
+#include "query_cache.hpp"
+
+#include <algorithm>
+
+
+namespace
+{
+  constexpr std::size_t kMaxShards = 16;
+}
+
+
+QueryCache::QueryCache(std::size_t capacity)
+  : m_num_shards{std::clamp<std::size_t>(capacity / 64, 1, kMaxShards)}
+  , m_capacity{capacity}
+{
+  m_shards = std::make_unique<shard_t[]>(m_num_shards);
+  for (std::size_t i = 0; i < m_num_shards; ++i)
+  {
+    // Split the capacity as evenly as possible
+    auto& shard    = m_shards[i];
+    shard.capacity = capacity / m_num_shards + (i < capacity % m_num_shards);
+    shard.entries.reserve(shard.capacity);
+    shard.index.reserve(shard.capacity);
+  }
+}
+
+void QueryCache::make_key(std::string_view word, int d, Kind kind, std::string& key)
+{
+  key.assign(word);
+  key.push_back(kind);
+  key.push_back(char('0' + d));
+}
+
+bool QueryCache::find(std::string_view word, int d, Kind kind, std::uint64_t generation,
+                      DictionaryMatch& result) const
+{
+  thread_local std::string key;
+  make_key(word, d, kind, key);
+
+  auto   hash  = std::hash<std::string_view>{}(key);
+  auto&  shard = m_shards[hash % m_num_shards];
+  bool   found = false;
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (auto r = shard.index.find(key); r != shard.index.end())
+    {
+      auto& e = shard.entries[r->second];
+      if (e.generation == generation)
+      {
+        e.referenced = true;
+        result       = e.value;
+        found        = true;
+      }
+    }
+  }
+
+  (found ? m_hits : m_misses).fetch_add(1, std::memory_order_relaxed);
+  return found;
+}
+
+void QueryCache::insert(std::string_view word, int d, Kind kind, std::uint64_t generation,
+                        const DictionaryMatch& result)
+{
+  thread_local std::string key;
+  make_key(word, d, kind, key);
+
+  auto  hash  = std::hash<std::string_view>{}(key);
+  auto& shard = m_shards[hash % m_num_shards];
+  if (shard.capacity == 0)
+    return;
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  // Refresh an existing entry
+  if (auto r = shard.index.find(key); r != shard.index.end())
+  {
+    auto& e      = shard.entries[r->second];
+    e.value      = result;
+    e.generation = generation;
+    e.referenced = true;
+    return;
+  }
+
+  std::size_t slot;
+  if (shard.entries.size() < shard.capacity)
+  {
+    slot = shard.entries.size();
+    shard.entries.push_back({});
+  }
+  else
+  {
+    // CLOCK: evict the first entry not referenced since the last pass of the hand
+    while (shard.entries[shard.hand].referenced)
+    {
+      shard.entries[shard.hand].referenced = false;
+      shard.hand                           = (shard.hand + 1) % shard.capacity;
+    }
+    slot       = shard.hand;
+    shard.hand = (shard.hand + 1) % shard.capacity;
+    shard.index.erase(shard.entries[slot].key);
+  }
+
+  auto& e      = shard.entries[slot];
+  e.key        = key;
+  e.value      = result;
+  e.generation = generation;
+  e.referenced = false;
+  shard.index.emplace(e.key, slot);
+}
+
+void QueryCache::clear()
+{
+  for (std::size_t i = 0; i < m_num_shards; ++i)
+  {
+    std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+    m_shards[i].index.clear();
+    m_shards[i].entries.clear();
+    m_shards[i].hand = 0;
+  }
+  m_hits   = 0;
+  m_misses = 0;
+}
+
+CacheStats QueryCache::stats() const
+{
+  CacheStats s;
+  s.hits     = m_hits.load(std::memory_order_relaxed);
+  s.misses   = m_misses.load(std::memory_order_relaxed);
+  s.capacity = m_capacity;
+  s.size     = 0;
+  for (std::size_t i = 0; i < m_num_shards; ++i)
+  {
+    std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+    s.size += m_shards[i].entries.size();
+  }
+  return s;
+}
+
+
+NegativeCache::NegativeCache(std::size_t capacity)
+  : m_num_shards{std::clamp<std::size_t>(capacity / 256, 1, kMaxShards)}
+{
+  m_buckets_per_shard = std::max<std::size_t>(1, capacity / (m_num_shards * kWays));
+  m_shards            = std::make_unique<shard_t[]>(m_num_shards);
+  for (std::size_t i = 0; i < m_num_shards; ++i)
+  {
+    m_shards[i].entries.assign(m_buckets_per_shard * kWays, 0);
+    m_shards[i].generation = 0;
+  }
+}
+
+bool NegativeCache::find(std::string_view word, int d, std::uint64_t generation) const
+{
+  auto  hash   = std::hash<std::string_view>{}(word);
+  auto  fp     = hash & ~std::uint64_t(3);
+  auto& shard  = m_shards[(hash >> 48) % m_num_shards];
+  auto  bucket = (hash % m_buckets_per_shard) * kWays;
+  bool  found  = false;
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.generation == generation)
+    {
+      for (int k = 0; k < kWays; ++k)
+      {
+        auto e = shard.entries[bucket + k];
+        if ((e & ~std::uint64_t(3)) == fp && (int)(e & 3) > d)
+        {
+          found = true;
+          break;
+        }
+      }
+    }
+  }
+
+  (found ? m_hits : m_misses).fetch_add(1, std::memory_order_relaxed);
+  return found;
+}
+
+void NegativeCache::insert(std::string_view word, int d, std::uint64_t generation)
+{
+  auto  hash   = std::hash<std::string_view>{}(word);
+  auto  fp     = hash & ~std::uint64_t(3);
+  auto& shard  = m_shards[(hash >> 48) % m_num_shards];
+  auto  bucket = (hash % m_buckets_per_shard) * kWays;
+  auto  entry  = fp | std::uint64_t(d + 1);
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  // The dictionary has changed, the known misses may now match
+  if (shard.generation != generation)
+  {
+    if (shard.generation > generation) // A result computed before the change
+      return;
+    std::fill(shard.entries.begin(), shard.entries.end(), 0);
+    shard.generation = generation;
+    shard.size       = 0;
+  }
+
+  auto* ways = shard.entries.data() + bucket;
+  for (int k = 0; k < kWays; ++k)
+  {
+    if ((ways[k] & ~std::uint64_t(3)) == fp)
+    {
+      ways[k] = std::max(ways[k], entry);
+      return;
+    }
+  }
+
+  // Insert in front of the bucket, the oldest entry is dropped
+  shard.size += (ways[kWays - 1] == 0);
+  std::copy_backward(ways, ways + kWays - 1, ways + kWays);
+  ways[0] = entry;
+}
+
+CacheStats NegativeCache::stats() const
+{
+  CacheStats s;
+  s.hits     = m_hits.load(std::memory_order_relaxed);
+  s.misses   = m_misses.load(std::memory_order_relaxed);
+  s.capacity = m_num_shards * m_buckets_per_shard * kWays;
+  s.size     = 0;
+  for (std::size_t i = 0; i < m_num_shards; ++i)
+  {
+    std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+    s.size += m_shards[i].size;
+  }
+  return s;
+}
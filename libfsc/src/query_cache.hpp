@@ -0,0 +1,95 @@
+#pragma once
+
+#include <fsc.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+/// Bounded cache of query results, sharded by key hash with a CLOCK eviction in each shard.
+///
+/// Entries are tagged with the generation of the dictionary they were computed on, an entry of an older
+/// generation is a miss (the dictionary has changed since).
+class QueryCache
+{
+public:
+  enum Kind : char
+  {
+    kBestMatch  = 'b',
+    kHasMatches = 'h',
+  };
+
+  explicit QueryCache(std::size_t capacity);
+
+  bool find(std::string_view word, int d, Kind kind, std::uint64_t generation, DictionaryMatch& result) const;
+  void insert(std::string_view word, int d, Kind kind, std::uint64_t generation, const DictionaryMatch& result);
+  void clear();
+
+  CacheStats stats() const;
+
+private:
+  struct entry_t
+  {
+    std::string     key;
+    DictionaryMatch value;
+    std::uint64_t   generation;
+    bool            referenced;
+  };
+
+  struct shard_t
+  {
+    std::mutex                                   mutex;
+    std::unordered_map<std::string_view, size_t> index;
+    std::vector<entry_t>                         entries; // Never reallocated (index keys point to the entries)
+    std::size_t                                  capacity = 0;
+    std::size_t                                  hand     = 0;
+  };
+
+  static void make_key(std::string_view word, int d, Kind kind, std::string& key);
+
+  std::unique_ptr<shard_t[]>         m_shards;
+  std::size_t                        m_num_shards;
+  std::size_t                        m_capacity;
+  mutable std::atomic<std::uint64_t> m_hits   = 0;
+  mutable std::atomic<std::uint64_t> m_misses = 0;
+};
+
+
+/// Compact set of the recent full misses (no word at a distance <= d).
+///
+/// An entry is a 62-bit fingerprint of the word with the largest distance known to miss (a miss at d is also a miss
+/// at any d' < d), stored in 4-way buckets. The collision probability of two fingerprints is negligible (~2^-60).
+/// The set is cleared when the generation of the dictionary changes (a new word may match a known miss).
+class NegativeCache
+{
+public:
+  explicit NegativeCache(std::size_t capacity);
+
+  bool find(std::string_view word, int d, std::uint64_t generation) const;
+  void insert(std::string_view word, int d, std::uint64_t generation);
+
+  CacheStats stats() const;
+
+private:
+  static constexpr int kWays = 4;
+
+  struct shard_t
+  {
+    std::mutex                 mutex;
+    std::vector<std::uint64_t> entries;    // fingerprint | (d + 1), 0 if empty
+    std::uint64_t              generation; // Generation of the entries
+    std::size_t                size = 0;
+  };
+
+  std::unique_ptr<shard_t[]>         m_shards;
+  std::size_t                        m_num_shards;
+  std::size_t                        m_buckets_per_shard;
+  mutable std::atomic<std::uint64_t> m_hits   = 0;
+  mutable std::atomic<std::uint64_t> m_misses = 0;
+};
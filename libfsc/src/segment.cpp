@@ -0,0 +1,78 @@
+#include <fsc_segment.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+
+
+namespace
+{
+  // Never split in the middle of a UTF-8 sequence (0x80-0xBF are not letters in Latin-1 either)
+  inline bool is_boundary(std::string_view text, std::size_t i)
+  {
+    return i == text.size() || ((unsigned char)text[i] & 0xC0) != 0x80;
+  }
+}
+
+
+Segmentation segment(Dictionary& dict, std::string_view text, int d, int budget, int chars_per_error)
+{
+  if (chars_per_error < 1)
+    throw std::invalid_argument("Invalid chars_per_error (Must be >= 1)");
+
+  struct state_t
+  {
+    int             distance = INT_MAX; // Best score of the prefix
+    int             count    = 0;       // Number of segments of the best segmentation of the prefix
+    std::size_t     previous = 0;       // Start of the last segment
+    DictionaryMatch match;              // Match of the last segment
+  };
+
+  const std::size_t n       = text.size();
+  const std::size_t max_len = std::min<std::size_t>(dict.longest_word_length() + d, dict.max_word_length());
+
+  std::vector<state_t> best(n + 1);
+  best[0].distance = 0;
+
+  for (std::size_t j = 0; j < n; ++j)
+  {
+    if (best[j].distance > budget || !is_boundary(text, j))
+      continue;
+
+    int chars = 0;
+    for (std::size_t i = j + 1; i <= n && i - j <= max_len; ++i)
+    {
+      chars += is_boundary(text, i - 1);
+      if (!is_boundary(text, i))
+        continue;
+
+      int allowed = std::min({d, chars / chars_per_error, budget - best[j].distance});
+      if (allowed < 0)
+        break;
+
+      auto m = dict.best_match(text.substr(j, i - j), allowed);
+      if (m.word == nullptr || m.distance > allowed)
+        continue;
+
+      int distance = best[j].distance + m.distance;
+      int count    = best[j].count + 1;
+      if (distance < best[i].distance || (distance == best[i].distance && count < best[i].count))
+      {
+        best[i].distance = distance;
+        best[i].count    = count;
+        best[i].previous = j;
+        best[i].match    = m;
+      }
+    }
+  }
+
+  Segmentation result;
+  result.distance = best[n].distance;
+  if (n == 0 || best[n].distance > budget)
+    return result;
+
+  for (std::size_t i = n; i > 0; i = best[i].previous)
+    result.segments.push_back({best[i].previous, i - best[i].previous, best[i].match});
+  std::reverse(result.segments.begin(), result.segments.end());
+  return result;
+}
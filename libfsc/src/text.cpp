@@ -0,0 +1,169 @@
+#include <fsc_text.hpp>
+
+#include <utility>
+
+
+namespace
+{
+  inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+  // The non-letters among the non-ASCII code points: Latin-1 punctuation and the punctuation blocks
+  bool is_separator(char32_t c)
+  {
+    if (c < 0xC0)
+      return c != 0xAA && c != 0xB5 && c != 0xBA; // But ª, µ and º
+    return c == 0xD7 || c == 0xF7                 // × and ÷
+           || (c >= 0x2000 && c <= 0x206F)        // General Punctuation (spaces, dashes, quotes, …)
+           || (c >= 0x20A0 && c <= 0x20CF)        // Currency symbols
+           || (c >= 0x2E00 && c <= 0x2E7F)        // Supplemental Punctuation
+           || (c >= 0x3000 && c <= 0x303F)        // CJK Symbols and Punctuation
+           || c == 0xFEFF;                        // Byte order mark
+  }
+
+  struct text_char_t
+  {
+    int  length; // In bytes (0 for a UTF-8 sequence cut by the end of the text)
+    bool word;   // Letter or digit
+  };
+
+  // The character at text[i]. The bytes that do not form valid UTF-8 are letters (e.g. Latin-1 text).
+  text_char_t read_char(std::string_view text, std::size_t i)
+  {
+    auto x = (unsigned char)text[i];
+    if (x < 0x80)
+      return {1, (x >= 'a' && x <= 'z') || (x >= 'A' && x <= 'Z') || (x >= '0' && x <= '9')};
+
+    int len = (x >= 0xF0) ? 4 : (x >= 0xE0) ? 3 : (x >= 0xC0) ? 2 : 1;
+    if (len == 1 || x > 0xF4)
+      return {1, true};
+
+    char32_t c = x & (0x7F >> len);
+    for (int k = 1; k < len; ++k)
+    {
+      if (i + k == text.size())
+        return {0, true};
+      auto y = (unsigned char)text[i + k];
+      if ((y & 0xC0) != 0x80)
+        return {1, true};
+      c = (c << 6) | (y & 0x3F);
+    }
+    return {len, !is_separator(c)};
+  }
+}
+
+
+TextCorrector::TextCorrector(Dictionary& dict, int d)
+  : m_dict{dict}
+  , m_max_distance{d}
+{
+}
+
+std::size_t TextCorrector::process(std::string_view text, bool last, Output& out)
+{
+  const std::size_t n = text.size();
+  std::size_t       i = 0;
+
+  // A character cut by the end of the last chunk is not valid UTF-8 (a letter)
+  auto char_at = [&](std::size_t j) {
+    auto c = read_char(text, j);
+    return (c.length == 0 && last) ? text_char_t{1, true} : c;
+  };
+
+  // The token pending from the previous chunks is not scanned again (a long token fed by small chunks)
+  std::size_t resume = std::exchange(m_scanned, 0);
+
+  while (i < n)
+  {
+    std::size_t start     = i;
+    bool        has_digit = false;
+    if (resume > 0)
+    {
+      i         = std::exchange(resume, 0);
+      has_digit = m_scanned_digit;
+    }
+    else
+    {
+      auto ch = char_at(i);
+      if (ch.length == 0)
+        return i; // Completed by the next chunk
+      if (!ch.word)
+      {
+        i += ch.length;
+        continue;
+      }
+    }
+
+    bool cut = false; // The token may continue in the next chunk
+    while (i < n)
+    {
+      auto ch = char_at(i);
+      if (ch.length == 0 || (text[i] == '-' && i + 1 == n && !last))
+      {
+        cut = true;
+        break;
+      }
+      if (ch.word)
+      {
+        has_digit |= is_digit(text[i]);
+        i += ch.length;
+        continue;
+      }
+
+      // '-' joins two runs
+      auto next = (text[i] == '-' && i + 1 < n) ? char_at(i + 1) : text_char_t{1, false};
+      if (next.length == 0)
+        cut = true;
+      if (next.length == 0 || !next.word)
+        break;
+      i++;
+    }
+
+    if (!last && (cut || i == n))
+    {
+      m_scanned       = i - start;
+      m_scanned_digit = has_digit;
+      return start;
+    }
+
+    auto token = text.substr(start, i - start);
+    if (has_digit || token.size() > (std::size_t)m_dict.max_word_length())
+      continue;
+
+    TextCorrection c;
+    c.offset = m_offset + start;
+    c.token  = token;
+    c.match  = m_dict.best_match(token, m_max_distance);
+    out.on_token(c);
+  }
+  return n;
+}
+
+void TextCorrector::feed(std::string_view chunk, Output& out)
+{
+  std::size_t done;
+  if (m_pending.empty())
+  {
+    done = this->process(chunk, false, out);
+    m_pending.assign(chunk.substr(done));
+  }
+  else
+  {
+    m_pending.append(chunk);
+    done = this->process(m_pending, false, out);
+    m_pending.erase(0, done);
+  }
+  m_offset += done;
+}
+
+void TextCorrector::finish(Output& out)
+{
+  m_offset += this->process(m_pending, true, out);
+  m_pending.clear();
+}
+
+void correct_text(Dictionary& dict, std::string_view text, int d, TextCorrector::Output& out)
+{
+  TextCorrector c(dict, d);
+  c.feed(text, out);
+  c.finish(out);
+}
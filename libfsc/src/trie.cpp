@@ -0,0 +1,75 @@
+#include "trie.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+
+CompactTrie::CompactTrie() { clear(); }
+
+void CompactTrie::clear()
+{
+  m_nodes.assign(1, node_t{});
+  m_blocks.clear();
+  m_block_used = kBlockSize;
+  m_num_words  = 0;
+}
+
+std::uint32_t CompactTrie::store(std::string_view word)
+{
+  std::size_t size = word.size() + 1;
+  if (size > kBlockSize)
+    throw std::runtime_error("Word too long");
+  if (m_block_used + size > kBlockSize)
+  {
+    if (m_blocks.size() >= (std::size_t(1) << (32 - kBlockBits)) - 1)
+      throw std::runtime_error("Too many words in the trie");
+    m_blocks.push_back(std::make_unique<char[]>(kBlockSize));
+    m_block_used = 0;
+  }
+  auto  pos = (std::uint32_t)(((m_blocks.size() - 1) << kBlockBits) + m_block_used);
+  char* p   = m_blocks.back().get() + m_block_used;
+  std::memcpy(p, word.data(), word.size());
+  p[word.size()] = 0;
+  m_block_used += size;
+  return pos;
+}
+
+const char* CompactTrie::insert(std::string_view word)
+{
+  std::uint32_t node = 0;
+  for (unsigned char label : word)
+  {
+    // The siblings are sorted by label
+    std::uint32_t prev = kNone;
+    std::uint32_t c    = m_nodes[node].first_child;
+    while (c != kNone && m_nodes[c].label < label)
+    {
+      prev = c;
+      c    = m_nodes[c].next_sibling;
+    }
+
+    if (c == kNone || m_nodes[c].label != label)
+    {
+      if (m_nodes.size() >= kNone)
+        throw std::runtime_error("Too many trie nodes");
+      auto added = (std::uint32_t)m_nodes.size();
+      node_t n;
+      n.label        = label;
+      n.next_sibling = c;
+      m_nodes.push_back(n);
+      if (prev == kNone)
+        m_nodes[node].first_child = added;
+      else
+        m_nodes[prev].next_sibling = added;
+      c = added;
+    }
+    node = c;
+  }
+
+  if (m_nodes[node].word == kNone)
+  {
+    m_nodes[node].word = store(word);
+    m_num_words++;
+  }
+  return word_at(m_nodes[node].word);
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+
+/// Trie of byte strings stored in a flat array of nodes (first child, next sibling, word), 16 bytes per node
+/// plus the words themselves (null-terminated, in an arena: the returned pointers are stable).
+///
+/// The words within a distance of a query are found by walking the trie with one row of the Levenshtein matrix
+/// per node, restricted to the diagonal band of the bound: a subtree is cut as soon as all the cells of its row
+/// exceed the bound.
+class CompactTrie
+{
+public:
+  CompactTrie();
+
+  void        clear();
+  // Insert a word and returns its stored copy (the existing one if already present)
+  const char* insert(std::string_view word);
+
+  std::size_t size() const { return m_num_words; }
+  std::size_t num_nodes() const { return m_nodes.size(); }
+  std::size_t node_bytes() const { return m_nodes.capacity() * sizeof(node_t); }
+  std::size_t word_bytes() const { return m_blocks.size() * kBlockSize; }
+
+  /// Call `visit(const char* word, int distance)` for the words at a distance <= bound of the query (Levenshtein
+  /// distance, or optimal string alignment distance with `transpositions`). `visit` returns the new bound, which
+  /// must not increase (< 0 stops the search). max_dist must be < 255.
+  template <class F>
+  void search(std::string_view query, int max_dist, bool transpositions, F&& visit) const;
+
+private:
+  static constexpr std::uint32_t kNone      = UINT32_MAX;
+  static constexpr int           kBlockBits = 16;
+  static constexpr std::size_t   kBlockSize = std::size_t(1) << kBlockBits;
+
+  struct node_t
+  {
+    std::uint32_t first_child  = kNone;
+    std::uint32_t next_sibling = kNone;
+    std::uint32_t word         = kNone; // Position of the word ending here in the arena (if any)
+    unsigned char label        = 0;
+  };
+
+  template <class F>
+  struct search_t;
+
+  std::uint32_t store(std::string_view word);
+  const char*   word_at(std::uint32_t pos) const
+  {
+    return m_blocks[pos >> kBlockBits].get() + (pos & (kBlockSize - 1));
+  }
+
+  std::vector<node_t>                  m_nodes; // m_nodes[0] is the root
+  std::vector<std::unique_ptr<char[]>> m_blocks;
+  std::size_t                          m_block_used = kBlockSize;
+  std::size_t                          m_num_words  = 0;
+};
+
+
+template <class F>
+struct CompactTrie::search_t
+{
+  const CompactTrie& trie;
+  std::string_view   query;
+  int                n;
+  int                bound;
+  int                cap; // Value of the cells > max_dist
+  bool               transpositions;
+  F&                 visit;
+  std::uint8_t*      rows;   // Row i (at depth i) starts at rows + i * (n + 1)
+  unsigned char*     labels; // Labels of the current path
+
+  std::uint8_t* row(int i) const { return rows + i * (n + 1); }
+
+  // Search the children of a node at depth i - 1 (returns false to stop the search)
+  bool descend(std::uint32_t parent, int i)
+  {
+    for (auto c = trie.m_nodes[parent].first_child; c != kNone; c = trie.m_nodes[c].next_sibling)
+      if (!search_node(c, i))
+        return false;
+    return true;
+  }
+
+  // Compute the row of a node at depth i, report its word and search its children
+  bool search_node(std::uint32_t c, int i)
+  {
+    if (i - bound > n) // Only deletions left, all > bound
+      return true;
+
+    const node_t&       node = trie.m_nodes[c];
+    const std::uint8_t* prev = row(i - 1);
+    std::uint8_t*       cur  = row(i);
+    int                 lo   = std::max(1, i - bound);
+    int                 hi   = std::min(n, i + bound);
+
+    labels[i - 1] = node.label;
+    cur[lo - 1]   = (lo == 1) ? (std::uint8_t)std::min(i, cap) : (std::uint8_t)cap;
+    int row_min   = cur[lo - 1];
+    for (int j = lo; j <= hi; ++j)
+    {
+      int v = std::min({prev[j - 1] + ((unsigned char)query[j - 1] != node.label), prev[j] + 1, cur[j - 1] + 1});
+      if (transpositions && i > 1 && j > 1 && node.label == (unsigned char)query[j - 2] &&
+          labels[i - 2] == (unsigned char)query[j - 1])
+        v = std::min(v, row(i - 2)[j - 2] + 1);
+      cur[j]  = (std::uint8_t)std::min(v, cap);
+      row_min = std::min(row_min, v);
+    }
+    if (hi < n)
+      cur[hi + 1] = (std::uint8_t)cap;
+
+    if (node.word != kNone && hi == n && cur[n] <= bound)
+    {
+      int next = visit(trie.word_at(node.word), (int)cur[n]);
+      if (next < 0)
+        return false;
+      bound = std::min(bound, next);
+    }
+
+    return row_min > bound || node.first_child == kNone || descend(c, i + 1);
+  }
+};
+
+
+template <class F>
+void CompactTrie::search(std::string_view query, int max_dist, bool transpositions, F&& visit) const
+{
+  int n   = query.size();
+  int cap = max_dist + 1;
+
+  // The search does not go deeper than n + max_dist
+  std::vector<std::uint8_t>  rows((n + max_dist + 1) * (n + 1));
+  std::vector<unsigned char> labels(n + max_dist + 1);
+  search_t<F>                s = {*this, query, n, max_dist, cap, transpositions, visit, rows.data(), labels.data()};
+
+  for (int j = 0; j <= n; ++j)
+    rows[j] = (std::uint8_t)std::min(j, cap);
+
+  if (m_nodes[0].word != kNone && n <= max_dist)
+  {
+    int next = visit(word_at(m_nodes[0].word), n);
+    if (next < 0)
+      return;
+    s.bound = std::min(s.bound, next);
+  }
+  if (s.bound >= 0)
+    s.descend(0, 1);
+}
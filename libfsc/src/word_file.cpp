@@ -0,0 +1,163 @@
+#include "word_file.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FSC_HAS_MMAP 1
+#endif
+
+
+MappedFile::MappedFile(const std::string& path)
+{
+#ifdef FSC_HAS_MMAP
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Unable to open " + path);
+
+  struct stat st;
+  if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+  {
+    m_size = st.st_size;
+    if (m_size == 0)
+    {
+      ::close(fd);
+      return;
+    }
+
+    void* p = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED)
+    {
+      ::madvise(p, m_size, MADV_SEQUENTIAL);
+      ::close(fd);
+      m_data   = static_cast<const char*>(p);
+      m_mapped = true;
+      return;
+    }
+  }
+  ::close(fd);
+#endif
+
+  // Not a regular file (or no mmap): read it
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("Unable to open " + path);
+  std::ostringstream ss;
+  ss << in.rdbuf();
+  m_buffer = std::move(ss).str();
+  m_data   = m_buffer.data();
+  m_size   = m_buffer.size();
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef FSC_HAS_MMAP
+  if (m_mapped)
+    ::munmap(const_cast<char*>(m_data), m_size);
+#endif
+}
+
+
+namespace
+{
+  // Position of the next '\n' in [s, end) (or end). The bytes are tested 8 at a time (SWAR).
+  const char* find_newline(const char* s, const char* end)
+  {
+    constexpr std::uint64_t kOnes = 0x0101010101010101ull;
+    constexpr std::uint64_t kHigh = 0x8080808080808080ull;
+    constexpr std::uint64_t kNewlines = kOnes * '\n';
+
+    for (; s + 8 <= end; s += 8)
+    {
+      std::uint64_t x;
+      std::memcpy(&x, s, 8);
+      x ^= kNewlines; // A '\n' byte is now 0
+      if ((x - kOnes) & ~x & kHigh)
+        break;
+    }
+    while (s < end && *s != '\n')
+      ++s;
+    return s;
+  }
+
+  void split_chunk(const char* begin, const char* end, std::vector<std::string_view>& lines)
+  {
+    while (begin < end)
+    {
+      const char* eol = find_newline(begin, end);
+      const char* e   = eol;
+      while (e > begin && (e[-1] == '\r' || e[-1] == ' ' || e[-1] == '\t'))
+        --e;
+      if (e > begin)
+        lines.emplace_back(begin, e - begin);
+      begin = eol + 1;
+    }
+  }
+}
+
+
+std::vector<std::string_view> split_lines(std::string_view text, int num_threads)
+{
+  constexpr std::size_t kMinChunkSize = 1 << 20;
+
+  const char* begin = text.data();
+  const char* end   = text.data() + text.size();
+
+  std::size_t n = std::clamp<std::size_t>(text.size() / kMinChunkSize, 1, std::max(num_threads, 1));
+  if (n == 1)
+  {
+    std::vector<std::string_view> lines;
+    split_chunk(begin, end, lines);
+    return lines;
+  }
+
+  // Chunks end after a newline
+  std::vector<const char*> bounds = {begin};
+  for (std::size_t i = 1; i < n; ++i)
+  {
+    const char* b = std::max(bounds.back(), begin + i * (text.size() / n));
+    b             = find_newline(b, end);
+    bounds.push_back(b < end ? b + 1 : end);
+  }
+  bounds.push_back(end);
+
+  std::vector<std::vector<std::string_view>> chunks(n);
+  std::vector<std::thread>                   threads;
+  for (std::size_t i = 0; i < n; ++i)
+    threads.emplace_back([&, i] { split_chunk(bounds[i], bounds[i + 1], chunks[i]); });
+  for (auto& t : threads)
+    t.join();
+
+  std::size_t total = 0;
+  for (const auto& c : chunks)
+    total += c.size();
+
+  std::vector<std::string_view> lines;
+  lines.reserve(total);
+  for (const auto& c : chunks)
+    lines.insert(lines.end(), c.begin(), c.end());
+  return lines;
+}
+
+
+void remove_duplicates(std::vector<std::string_view>& words)
+{
+  std::unordered_set<std::string_view> seen;
+  seen.reserve(words.size());
+
+  std::size_t n = 0;
+  for (auto w : words)
+    if (seen.insert(w).second)
+      words[n++] = w;
+  words.resize(n);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+/// Read-only view of a whole file (mapped in memory when the platform allows it, read otherwise)
+class MappedFile
+{
+public:
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&)            = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  std::string_view data() const { return {m_data, m_size}; }
+
+private:
+  const char* m_data = nullptr;
+  std::size_t m_size = 0;
+  bool        m_mapped = false;
+  std::string m_buffer; // If not mapped
+};
+
+
+/// The lines of a text without their trailing whitespaces ("\r", spaces, tabs). The empty lines are skipped. The
+/// text is split in chunks scanned by `num_threads` threads.
+std::vector<std::string_view> split_lines(std::string_view text, int num_threads = 1);
+
+/// Remove the duplicate words (the first occurrence is kept in place)
+void remove_duplicates(std::vector<std::string_view>& words);
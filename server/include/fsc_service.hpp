@@ -0,0 +1,90 @@
+#pragma once
+
+#include <fsc.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+/// Correction service: a server answering batches of queries from a shared dictionary on a Unix domain socket.
+///
+/// Each request frame is a batch of words with an operation (best_match or has_matches) and a distance. The
+/// responses are sent in the order of the requests, so a client can pipeline several batches before reading the
+/// responses. See src/protocol.hpp for the framing.
+class CorrectionServer
+{
+public:
+  /// Listen on `socket_path` (an existing socket file is replaced). The dictionary must outlive the server and
+  /// must not be loaded while it runs.
+  CorrectionServer(Dictionary& dict, std::string socket_path);
+  ~CorrectionServer(); // Stop and join the connections
+
+  CorrectionServer(const CorrectionServer&)            = delete;
+  CorrectionServer& operator=(const CorrectionServer&) = delete;
+
+  /// Accept and serve the connections (one thread each) until stop()
+  void run();
+  void stop();
+
+private:
+  struct Connection
+  {
+    std::thread       thread;
+    std::atomic<bool> done = false;
+  };
+
+  void serve(int fd, std::atomic<bool>& done);
+
+  Dictionary&           m_dict;
+  std::string           m_path;
+  int                   m_listen_fd = -1;
+  std::atomic<bool>     m_stopping  = false;
+  std::list<Connection> m_connections; // Only used by run() and the destructor
+};
+
+
+struct RemoteMatch
+{
+  std::string word;     // The best match (empty for has_matches)
+  int         distance; // -1 if there is no match within d (for has_matches, a distance <= d otherwise)
+  int         count;
+};
+
+
+/// Client of a CorrectionServer (one connection, not thread-safe)
+class CorrectionClient
+{
+public:
+  enum Op : std::uint8_t
+  {
+    kBestMatch  = 1,
+    kHasMatches = 2,
+  };
+
+  explicit CorrectionClient(const std::string& socket_path);
+  ~CorrectionClient();
+
+  CorrectionClient(const CorrectionClient&)            = delete;
+  CorrectionClient& operator=(const CorrectionClient&) = delete;
+
+  /// A request and its response are each limited to 64 MB: a response entry is 8 bytes plus the best match, so a
+  /// batch of up to 1M words whose matches are up to 48 bytes always fits. The server reports a larger response as
+  /// an error.
+  std::vector<RemoteMatch> best_match(const std::vector<std::string_view>& words, int d);
+  std::vector<bool>        has_matches(const std::vector<std::string_view>& words, int d);
+
+  /// Pipelining: send several batches, then receive their responses in the same order. receive throws the errors
+  /// reported by the server (std::runtime_error). The server answers one batch at a time: a client that sends more
+  /// than a socket buffer of responses without receiving them can deadlock.
+  void                     send(Op op, const std::vector<std::string_view>& words, int d);
+  std::vector<RemoteMatch> receive();
+
+private:
+  int               m_fd = -1;
+  std::vector<char> m_buffer;
+};
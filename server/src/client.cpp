@@ -0,0 +1,100 @@
+#include <fsc_service.hpp>
+
+#include "protocol.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace fsc_protocol;
+
+
+CorrectionClient::CorrectionClient(const std::string& socket_path)
+{
+  sockaddr_un addr = {};
+  addr.sun_family  = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("Socket path too long: " + socket_path);
+  std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+  m_fd = open_socket();
+  if (m_fd < 0 || ::connect(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+  {
+    std::string message = socket_path + ": " + std::strerror(errno);
+    if (m_fd >= 0)
+      ::close(m_fd);
+    throw std::runtime_error(message);
+  }
+}
+
+CorrectionClient::~CorrectionClient() { ::close(m_fd); }
+
+void CorrectionClient::send(Op op, const std::vector<std::string_view>& words, int d)
+{
+  if (d < 0 || d > INT8_MAX)
+    throw std::runtime_error("Invalid distance: " + std::to_string(d));
+
+  m_buffer.resize(sizeof(std::uint32_t));
+  put(m_buffer, header_t{op, (std::uint8_t)d, 0, (std::uint32_t)words.size()});
+  for (auto w : words)
+  {
+    if (w.size() > UINT16_MAX)
+      throw std::runtime_error("Word too long for the protocol");
+    put(m_buffer, (std::uint16_t)w.size());
+    put_bytes(m_buffer, w);
+  }
+  if (m_buffer.size() > kMaxFrameSize)
+    throw std::runtime_error("Batch too large for the protocol");
+  if (!write_frame(m_fd, m_buffer))
+    throw std::runtime_error(std::string("Failed to send the request: ") + std::strerror(errno));
+}
+
+std::vector<RemoteMatch> CorrectionClient::receive()
+{
+  if (!read_frame(m_fd, m_buffer))
+    throw std::runtime_error("Connection closed by the server");
+
+  std::size_t pos = 0;
+  header_t    h;
+  if (!get(m_buffer, pos, h))
+    throw std::runtime_error("Malformed response");
+
+  if (h.op_or_status != kOk)
+  {
+    std::string_view message;
+    get_bytes(m_buffer, pos, h.n, message);
+    throw std::runtime_error(std::string(message));
+  }
+
+  std::vector<RemoteMatch> matches(h.n);
+  for (auto& m : matches)
+  {
+    result_t         r;
+    std::string_view word;
+    if (!get(m_buffer, pos, r) || !get_bytes(m_buffer, pos, r.length, word))
+      throw std::runtime_error("Malformed response");
+    m.word     = word;
+    m.distance = r.distance;
+    m.count    = (int)r.count;
+  }
+  return matches;
+}
+
+std::vector<RemoteMatch> CorrectionClient::best_match(const std::vector<std::string_view>& words, int d)
+{
+  send(kBestMatch, words, d);
+  return receive();
+}
+
+std::vector<bool> CorrectionClient::has_matches(const std::vector<std::string_view>& words, int d)
+{
+  send(kHasMatches, words, d);
+  auto              matches = receive();
+  std::vector<bool> found(matches.size());
+  for (std::size_t i = 0; i < matches.size(); ++i)
+    found[i] = matches[i].distance >= 0;
+  return found;
+}
@@ -0,0 +1,49 @@
+// fsc_server SOCKET WORD_FILE [NUM_THREADS]
+//
+// Load a word list (one word per line) and answer the queries of CorrectionClient on a Unix domain socket until
+// SIGINT or SIGTERM.
+#include <fsc_service.hpp>
+
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+  CorrectionServer* g_server = nullptr;
+
+  extern "C" void on_signal(int) { g_server->stop(); }
+}
+
+
+int main(int argc, char** argv)
+{
+  if (argc < 3 || argc > 4)
+  {
+    std::cerr << "usage: " << argv[0] << " SOCKET WORD_FILE [NUM_THREADS]\n";
+    return 2;
+  }
+
+  try
+  {
+    int        num_threads = (argc == 4) ? std::atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+    Dictionary dict;
+    dict.load_file(argv[2], std::max(num_threads, 1));
+    std::cerr << "Loaded " << dict.num_words() << " words\n";
+
+    CorrectionServer server(dict, argv[1]);
+    g_server = &server;
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::cerr << "Listening on " << argv[1] << '\n';
+    server.run();
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+  return 0;
+}
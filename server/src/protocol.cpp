@@ -0,0 +1,111 @@
+#include "protocol.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+
+namespace
+{
+  // Set the flags that the system has no socket()/accept4() flags for (closes fd on error)
+  int setup_socket(int fd)
+  {
+    if (fd < 0)
+      return fd;
+#if !defined(__linux__)
+    if (::fcntl(fd, F_SETFD, FD_CLOEXEC) < 0)
+    {
+      int err = errno;
+      ::close(fd);
+      errno = err;
+      return -1;
+    }
+#endif
+#if defined(SO_NOSIGPIPE)
+    int on = 1;
+    if (::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on)) < 0)
+    {
+      int err = errno;
+      ::close(fd);
+      errno = err;
+      return -1;
+    }
+#endif
+    return fd;
+  }
+}
+
+
+namespace fsc_protocol
+{
+  int open_socket()
+  {
+#if defined(__linux__)
+    return setup_socket(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+#else
+    return setup_socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+#endif
+  }
+
+  int accept_socket(int listen_fd)
+  {
+#if defined(__linux__)
+    return setup_socket(::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC));
+#else
+    return setup_socket(::accept(listen_fd, nullptr, nullptr));
+#endif
+  }
+
+  bool write_all(int fd, const char* data, std::size_t n)
+  {
+    while (n > 0)
+    {
+      auto k = ::send(fd, data, n, MSG_NOSIGNAL);
+      if (k < 0 && errno == EINTR)
+        continue;
+      if (k <= 0)
+        return false;
+      data += k;
+      n -= k;
+    }
+    return true;
+  }
+
+  bool read_all(int fd, char* data, std::size_t n)
+  {
+    while (n > 0)
+    {
+      auto k = ::read(fd, data, n);
+      if (k < 0 && errno == EINTR)
+        continue;
+      if (k <= 0)
+        return false;
+      data += k;
+      n -= k;
+    }
+    return true;
+  }
+
+  bool read_frame(int fd, std::vector<char>& frame)
+  {
+    std::uint32_t size;
+    if (!read_all(fd, reinterpret_cast<char*>(&size), sizeof(size)) || size > kMaxFrameSize)
+      return false;
+    frame.resize(size);
+    return read_all(fd, frame.data(), size);
+  }
+
+  bool write_frame(int fd, std::vector<char>& frame)
+  {
+    if (frame.size() - sizeof(std::uint32_t) > kMaxFrameSize)
+      return false;
+    std::uint32_t size = (std::uint32_t)(frame.size() - sizeof(size));
+    std::memcpy(frame.data(), &size, sizeof(size));
+    return write_all(fd, frame.data(), frame.size());
+  }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+// Framing of the correction service (native byte order, the socket is local).
+//
+// Request:  u32 size (of the rest of the frame)
+//           u8 op (1: best_match, 2: has_matches), u8 d, u16 reserved, u32 n
+//           n x (u16 length, length bytes)
+// Response: u32 size (of the rest of the frame)
+//           u8 status (0: ok, 1: error), u8 op, u16 reserved, u32 n
+//           ok:    n x (i8 distance (-1: no match), u8 reserved, u16 length, u32 count, length bytes of the word)
+//           error: n bytes of message
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+
+namespace fsc_protocol
+{
+  constexpr std::size_t kMaxFrameSize = 64 << 20;
+
+  struct header_t
+  {
+    std::uint8_t  op_or_status;
+    std::uint8_t  arg; // d (request) or op (response)
+    std::uint16_t reserved;
+    std::uint32_t n;
+  };
+
+  struct result_t
+  {
+    std::int8_t   distance;
+    std::uint8_t  reserved;
+    std::uint16_t length;
+    std::uint32_t count;
+  };
+
+  enum Status : std::uint8_t
+  {
+    kOk    = 0,
+    kError = 1,
+  };
+
+  template <class T>
+  void put(std::vector<char>& out, const T& value)
+  {
+    auto p = reinterpret_cast<const char*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+  }
+
+  inline void put_bytes(std::vector<char>& out, std::string_view s) { out.insert(out.end(), s.begin(), s.end()); }
+
+  // Read a T at pos (false if the frame is too short)
+  template <class T>
+  bool get(const std::vector<char>& in, std::size_t& pos, T& value)
+  {
+    if (in.size() - pos < sizeof(T))
+      return false;
+    std::memcpy(&value, in.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+  }
+
+  inline bool get_bytes(const std::vector<char>& in, std::size_t& pos, std::size_t n, std::string_view& s)
+  {
+    if (in.size() - pos < n)
+      return false;
+    s = {in.data() + pos, n};
+    pos += n;
+    return true;
+  }
+
+  // Unix domain stream socket / accepted connection, close-on-exec and without SIGPIPE on a closed peer (-1 and
+  // errno on error). Linux has the flags for it, the other Unix systems get fcntl and SO_NOSIGPIPE.
+  int open_socket();
+  int accept_socket(int listen_fd);
+
+  // Blocking I/O of whole buffers (false on error or end of stream)
+  bool write_all(int fd, const char* data, std::size_t n);
+  bool read_all(int fd, char* data, std::size_t n);
+
+  // Read a frame (size prefix removed) in `frame`
+  bool read_frame(int fd, std::vector<char>& frame);
+  // Write a frame whose first 4 bytes are reserved for its size (false if it is larger than kMaxFrameSize)
+  bool write_frame(int fd, std::vector<char>& frame);
+}
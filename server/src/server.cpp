@@ -0,0 +1,194 @@
+#include <fsc_service.hpp>
+
+#include "protocol.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace fsc_protocol;
+
+
+namespace
+{
+  constexpr int kPollTimeoutMs = 100; // Latency of stop()
+
+  [[noreturn]] void throw_errno(const char* what)
+  {
+    throw std::runtime_error(std::string(what) + ": " + std::strerror(errno));
+  }
+
+  // Wait until fd is readable (false if the server stops first)
+  bool wait_readable(int fd, const std::atomic<bool>& stopping)
+  {
+    pollfd p = {fd, POLLIN, 0};
+    while (!stopping.load())
+    {
+      int k = ::poll(&p, 1, kPollTimeoutMs);
+      if (k > 0)
+        return true;
+      if (k < 0 && errno != EINTR)
+        return false;
+    }
+    return false;
+  }
+
+  void error_response(std::vector<char>& out, std::uint8_t op, std::string_view message)
+  {
+    out.resize(sizeof(std::uint32_t));
+    put(out, header_t{kError, op, 0, (std::uint32_t)message.size()});
+    put_bytes(out, message);
+  }
+
+  // Answer a request frame in `out` (false if the frame is malformed). A response larger than a frame is replaced by
+  // an error.
+  bool answer(Dictionary& dict, const std::vector<char>& in, std::vector<char>& out)
+  {
+    std::size_t pos = 0;
+    header_t    h;
+    if (!get(in, pos, h))
+      return false;
+
+    if (h.op_or_status != CorrectionClient::kBestMatch && h.op_or_status != CorrectionClient::kHasMatches)
+    {
+      error_response(out, h.op_or_status, "unknown operation");
+      return true;
+    }
+
+    out.resize(sizeof(std::uint32_t));
+    put(out, header_t{kOk, h.op_or_status, 0, h.n});
+    for (std::uint32_t i = 0; i < h.n; ++i)
+    {
+      std::uint16_t    length;
+      std::string_view w;
+      if (!get(in, pos, length) || !get_bytes(in, pos, length, w))
+        return false;
+      if (out.size() - sizeof(std::uint32_t) > kMaxFrameSize)
+      {
+        error_response(out, h.op_or_status, "response too large (split the batch)");
+        return true;
+      }
+
+      result_t r = {-1, 0, 0, 0};
+      if (h.op_or_status == CorrectionClient::kHasMatches)
+      {
+        if (dict.has_matches(w, h.arg))
+          r.distance = (std::int8_t)h.arg;
+        put(out, r);
+        continue;
+      }
+
+      auto m = dict.best_match(w, h.arg);
+      if (m.distance > h.arg || m.word == nullptr)
+      {
+        put(out, r);
+        continue;
+      }
+      std::string_view best = m.word;
+      r.distance            = (std::int8_t)m.distance;
+      r.length              = (std::uint16_t)best.size();
+      r.count               = (std::uint32_t)m.count;
+      put(out, r);
+      put_bytes(out, best);
+    }
+    if (out.size() - sizeof(std::uint32_t) > kMaxFrameSize)
+      error_response(out, h.op_or_status, "response too large (split the batch)");
+    return pos == in.size();
+  }
+}
+
+
+CorrectionServer::CorrectionServer(Dictionary& dict, std::string socket_path)
+  : m_dict(dict)
+  , m_path(std::move(socket_path))
+{
+  sockaddr_un addr = {};
+  addr.sun_family  = AF_UNIX;
+  if (m_path.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("Socket path too long: " + m_path);
+  std::memcpy(addr.sun_path, m_path.c_str(), m_path.size() + 1);
+
+  m_listen_fd = open_socket();
+  if (m_listen_fd < 0)
+    throw_errno("socket");
+
+  ::unlink(m_path.c_str());
+  if (::bind(m_listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(m_listen_fd, 64) < 0)
+  {
+    int err = errno;
+    ::close(m_listen_fd);
+    errno = err;
+    throw_errno(m_path.c_str());
+  }
+}
+
+CorrectionServer::~CorrectionServer()
+{
+  stop();
+  for (auto& c : m_connections)
+    c.thread.join();
+  ::close(m_listen_fd);
+  ::unlink(m_path.c_str());
+}
+
+void CorrectionServer::stop() { m_stopping.store(true); }
+
+void CorrectionServer::run()
+{
+  while (wait_readable(m_listen_fd, m_stopping))
+  {
+    int fd = accept_socket(m_listen_fd);
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      throw_errno("accept");
+    }
+
+    // Join the closed connections
+    for (auto it = m_connections.begin(); it != m_connections.end();)
+    {
+      if (it->done.load())
+      {
+        it->thread.join();
+        it = m_connections.erase(it);
+      }
+      else
+        ++it;
+    }
+    auto& c  = m_connections.emplace_back();
+    c.thread = std::thread(&CorrectionServer::serve, this, fd, std::ref(c.done));
+  }
+}
+
+// The requests of a connection are answered in order, so that the responses to pipelined batches are in the order
+// of the requests.
+void CorrectionServer::serve(int fd, std::atomic<bool>& done)
+{
+  std::vector<char> in, out;
+  while (wait_readable(fd, m_stopping))
+  {
+    if (!read_frame(fd, in))
+      break;
+    bool ok;
+    try
+    {
+      ok = answer(m_dict, in, out);
+    }
+    catch (const std::exception& e)
+    {
+      error_response(out, 0, e.what());
+      ok = true;
+    }
+    if (!ok)
+      error_response(out, 0, "malformed request");
+    if (!write_frame(fd, out) || !ok)
+      break;
+  }
+  ::close(fd);
+  done.store(true);
+}
@@ -1,3 +1,4 @@
+import os
 from setuptools import setup
 from pybind11.setup_helpers import Pybind11Extension
 
@@ -7,9 +8,20 @@ __version__ = "0.0.4"
 ext_modules = [
     Pybind11Extension(
         "FastSpellChecker._backend",
-        sources = [ "FastSpellChecker/FastSpellChecker.cpp", "libfsc/src/fsc.cpp"],
+        sources = [ "FastSpellChecker/FastSpellChecker.cpp", "libfsc/src/fsc.cpp", "libfsc/src/edit_costs.cpp",
+                   "libfsc/src/normalize.cpp",
+                   "libfsc/src/text.cpp",
+                   "libfsc/src/phrase.cpp",
+                   "libfsc/src/segment.cpp",
+                   "libfsc/src/query_cache.cpp",
+                   "libfsc/src/latency.cpp",
+                   "libfsc/src/word_file.cpp",
+                   "libfsc/src/trie.cpp",
+                   "libfsc/src/perfect_hash.cpp",
+                   "libfsc/src/async.cpp"],
         cxx_std=17,
         include_dirs=["libfsc/include"],
+        define_macros=[("FSC_QUERY_COUNTERS", "1")] if os.environ.get("FSC_QUERY_COUNTERS") == "1" else [],
         extra_link_args = ['-static-libstdc++']
     ),
 ]
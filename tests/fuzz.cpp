@@ -0,0 +1,206 @@
+// Differential tests of the index against a brute-force scan of the dictionary with edit_distance
+#include <fsc.hpp>
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <climits>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+  constexpr int kMaxDist = 2;
+
+  struct Oracle
+  {
+    int         distance = INT_MAX; // The min distance
+    int         count    = 0;       // Number of words at this distance
+    std::set<std::string> within[kMaxDist + 1]; // Words at a distance <= d
+  };
+
+  Oracle brute_force(const std::vector<std::string>& words, std::string_view query)
+  {
+    Oracle r;
+    for (const auto& w : words)
+    {
+      int dist = edit_distance(w, query);
+      if (dist < r.distance)
+      {
+        r.distance = dist;
+        r.count    = 0;
+      }
+      if (dist == r.distance)
+        r.count++;
+      for (int d = dist; d <= kMaxDist; ++d)
+        r.within[d].insert(w);
+    }
+    return r;
+  }
+
+  // Random word over the first `alphabet` letters (small alphabets give repeated letters and many collisions)
+  std::string random_word(std::mt19937& gen, int min_length, int max_length, int alphabet)
+  {
+    std::string w(std::uniform_int_distribution<int>(min_length, max_length)(gen), 'a');
+    for (auto& c : w)
+      c = (char)('a' + gen() % alphabet);
+    return w;
+  }
+
+  // Apply up to n random edits
+  std::string mutate(std::string w, int n, std::mt19937& gen, int alphabet, std::size_t max_length)
+  {
+    for (int k = 0; k < n; ++k)
+    {
+      char c   = (char)('a' + gen() % alphabet);
+      auto pos = w.empty() ? 0 : gen() % (w.size() + 1);
+      switch (gen() % 3)
+      {
+      case 0:
+        if (w.size() < max_length)
+          w.insert(w.begin() + pos, c);
+        break;
+      case 1:
+        if (pos < w.size())
+          w.erase(pos, 1);
+        break;
+      default:
+        if (pos < w.size())
+          w[pos] = c;
+      }
+    }
+    return w;
+  }
+
+  void check(Dictionary& dict, bool exact_count, const std::vector<std::string>& words, const std::string& query)
+  {
+    auto expected = brute_force(words, query);
+    for (int d = 0; d <= kMaxDist; ++d)
+    {
+      SCOPED_TRACE("query=\"" + query + "\" d=" + std::to_string(d));
+
+      bool found = expected.distance <= d;
+      ASSERT_EQ(dict.has_matches(query, d), found);
+
+      auto m = dict.best_match(query, d);
+      if (found)
+      {
+        ASSERT_EQ(m.distance, expected.distance);
+        if (exact_count)
+          ASSERT_EQ(m.count, expected.count);
+        else
+          ASSERT_TRUE(m.count >= 1 && m.count <= expected.count) << m.count << " vs " << expected.count;
+        ASSERT_NE(m.word, nullptr);
+        ASSERT_EQ(edit_distance(m.word, query), expected.distance);
+      }
+      else
+      {
+        ASSERT_GT(m.distance, d);
+      }
+
+      std::set<std::string> candidates;
+      for (const auto& c : dict.candidates(query, d))
+        candidates.insert(c.word);
+      ASSERT_EQ(candidates, expected.within[d]);
+    }
+  }
+
+  // Random dictionary of distinct words and queries derived from it
+  void run(unsigned seed, int num_words, int min_length, int max_length, int alphabet, int num_queries,
+           bool exact_count, DictionaryBackend backend = DictionaryBackend::HashTable, std::size_t memory_budget = 0)
+  {
+    SCOPED_TRACE("seed=" + std::to_string(seed) + (exact_count ? " exact_count" : "") +
+                 " backend=" + std::to_string((int)backend) + " budget=" + std::to_string(memory_budget));
+    std::mt19937 gen(seed);
+
+    std::set<std::string> unique;
+    while ((int)unique.size() < num_words)
+      unique.insert(random_word(gen, min_length, max_length, alphabet));
+    std::vector<std::string> words(unique.begin(), unique.end());
+    std::shuffle(words.begin(), words.end(), gen);
+
+    std::vector<std::string_view> views(words.begin(), words.end());
+    DictionaryOptions opts;
+    opts.exact_count = exact_count;
+    opts.backend       = backend;
+    opts.memory_budget = memory_budget;
+    Dictionary dict(opts);
+    dict.load(views.data(), views.size());
+
+    for (int i = 0; i < num_queries; ++i)
+    {
+      std::string query;
+      if (i % 4 == 0)
+        query = random_word(gen, std::max(0, min_length - 2), max_length + 2, alphabet);
+      else
+        query = mutate(words[gen() % words.size()], i % 4, gen, alphabet, dict.max_word_length());
+      check(dict, exact_count, words, query);
+      if (testing::Test::HasFatalFailure())
+        return;
+    }
+  }
+}
+
+
+TEST(Fuzz, short_words_small_alphabet)
+{
+  for (unsigned seed = 1; seed <= 20; ++seed)
+    for (bool exact_count : {false, true})
+      for (auto backend : {DictionaryBackend::HashTable, DictionaryBackend::Trie, DictionaryBackend::Frozen})
+        run(seed, 50, 0, 6, 2, 50, exact_count, backend);
+}
+
+TEST(Fuzz, short_words)
+{
+  for (unsigned seed = 1; seed <= 10; ++seed)
+    for (bool exact_count : {false, true})
+      for (auto backend : {DictionaryBackend::HashTable, DictionaryBackend::Trie, DictionaryBackend::Frozen})
+        run(seed, 300, 1, 10, 4, 100, exact_count, backend);
+}
+
+TEST(Fuzz, medium_words)
+{
+  for (unsigned seed = 1; seed <= 5; ++seed)
+    for (bool exact_count : {false, true})
+      for (auto backend : {DictionaryBackend::HashTable, DictionaryBackend::Trie, DictionaryBackend::Frozen})
+        run(seed, 200, 8, 20, 26, 100, exact_count, backend);
+}
+
+TEST(Fuzz, long_words)
+{
+  for (unsigned seed = 1; seed <= 2; ++seed)
+    for (bool exact_count : {false, true})
+      for (auto backend : {DictionaryBackend::HashTable, DictionaryBackend::Trie, DictionaryBackend::Frozen})
+        run(seed, 10, 120, 254, 3, 20, exact_count, backend);
+}
+
+// Part of the words (the longest ones) out of the index
+TEST(Fuzz, memory_budget)
+{
+  for (unsigned seed = 1; seed <= 5; ++seed)
+    for (bool exact_count : {false, true})
+      for (auto backend : {DictionaryBackend::HashTable, DictionaryBackend::Trie, DictionaryBackend::Frozen})
+      {
+        run(seed, 200, 4, 20, 4, 100, exact_count, backend, 20'000);
+        run(seed, 100, 0, 8, 3, 100, exact_count, backend, 1);
+      }
+}
+
+TEST(Fuzz, empty_string)
+{
+  std::vector<std::string> words = {"", "a", "ab", "abc", "b"};
+  std::vector<std::string_view> views(words.begin(), words.end());
+  for (auto backend : {DictionaryBackend::HashTable, DictionaryBackend::Trie, DictionaryBackend::Frozen})
+  {
+    DictionaryOptions opts;
+    opts.exact_count = true;
+    opts.backend     = backend;
+    Dictionary dict(opts);
+    dict.load(views.data(), views.size());
+
+    for (auto q : {"", "a", "c", "cc", "abcd", "ccc"})
+      check(dict, true, words, q);
+  }
+}
@@ -0,0 +1,114 @@
+// Tests of the correction server and client on a Unix domain socket
+#include <fsc_service.hpp>
+
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+
+namespace
+{
+  struct Service : testing::Test
+  {
+    Service()
+      : path((std::filesystem::temp_directory_path() / ("fsc_test_" + std::to_string(::getpid()) + ".sock")).string())
+    {
+      std::vector<std::string_view> words = {"hello", "help", "world", "word", "spell"};
+      dict.load(words.data(), words.size());
+      server = std::make_unique<CorrectionServer>(dict, path);
+      thread = std::thread([this] { server->run(); });
+    }
+
+    ~Service()
+    {
+      server->stop();
+      thread.join();
+    }
+
+    std::string                       path;
+    Dictionary                        dict;
+    std::unique_ptr<CorrectionServer> server;
+    std::thread                       thread;
+  };
+}
+
+
+TEST_F(Service, best_match)
+{
+  CorrectionClient client(path);
+  auto             m = client.best_match({"wrld", "spel", "xxxxxxx", ""}, 1);
+  ASSERT_EQ(m.size(), 4);
+  EXPECT_EQ(m[0].word, "world");
+  EXPECT_EQ(m[0].distance, 1);
+  EXPECT_EQ(m[0].count, 1);
+  EXPECT_EQ(m[1].word, "spell");
+  EXPECT_EQ(m[2].distance, -1);
+  EXPECT_EQ(m[2].word, "");
+  EXPECT_EQ(m[3].distance, -1);
+}
+
+TEST_F(Service, has_matches)
+{
+  CorrectionClient client(path);
+  EXPECT_EQ(client.has_matches({"helo", "xyz", "word"}, 1), (std::vector<bool>{true, false, true}));
+  EXPECT_EQ(client.has_matches({}, 1), std::vector<bool>{});
+}
+
+TEST_F(Service, pipelining)
+{
+  CorrectionClient client(path);
+  client.send(CorrectionClient::kBestMatch, {"hellox"}, 1);
+  client.send(CorrectionClient::kHasMatches, {"wxrd", "zzzz"}, 1);
+  client.send(CorrectionClient::kBestMatch, {"word"}, 0);
+
+  auto a = client.receive();
+  auto b = client.receive();
+  auto c = client.receive();
+  ASSERT_EQ(a.size(), 1);
+  EXPECT_EQ(a[0].word, "hello");
+  ASSERT_EQ(b.size(), 2);
+  EXPECT_GE(b[0].distance, 0);
+  EXPECT_EQ(b[1].distance, -1);
+  ASSERT_EQ(c.size(), 1);
+  EXPECT_EQ(c[0].word, "word");
+  EXPECT_EQ(c[0].distance, 0);
+}
+
+TEST_F(Service, concurrent_clients)
+{
+  std::vector<std::thread> threads;
+  std::vector<int>         errors(4);
+  for (int t = 0; t < 4; ++t)
+    threads.emplace_back([&, t] {
+      CorrectionClient client(path);
+      for (int i = 0; i < 100; ++i)
+      {
+        auto m = client.best_match({"wrld", "helpp"}, 1);
+        errors[t] += (m[0].word != "world") + (m[1].word != "help");
+      }
+    });
+  for (auto& t : threads)
+    t.join();
+  EXPECT_EQ(errors, std::vector<int>(4, 0));
+}
+
+TEST_F(Service, errors)
+{
+  CorrectionClient client(path);
+  EXPECT_THROW(client.best_match({"hello"}, -1), std::runtime_error);
+  std::string long_word(70000, 'a');
+  EXPECT_THROW(client.best_match({long_word}, 1), std::runtime_error);
+
+  // The connection is still usable
+  EXPECT_EQ(client.best_match({"hello"}, 0)[0].word, "hello");
+
+  // A request of 16 MB whose response (8 bytes per word) is larger than a frame
+  std::vector<std::string_view> empty_words((64 << 20) / 8 + 1);
+  EXPECT_THROW(client.has_matches(empty_words, 1), std::runtime_error);
+  EXPECT_EQ(client.has_matches({"word"}, 0), std::vector<bool>{true});
+
+  EXPECT_THROW(CorrectionClient("/nonexistent/fsc.sock"), std::runtime_error);
+}
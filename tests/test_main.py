@@ -1,4 +1,5 @@
-from FastSpellChecker import Dictionary
+import pytest
+from FastSpellChecker import Backend, Dictionary, EditCosts
 
 def test_0():
     d = Dictionary()
@@ -42,3 +43,166 @@ def test_no_result():
     #m = d.best_match("pro", 1)
     #assert m is None
 
+
+def test_transposition():
+    d = Dictionary(["ureu", "part"], transpositions=True)
+    m = d.best_match("urue", 1)
+    assert m["word"] == "ureu"
+    assert m["distance"] == 1
+
+def test_edit_costs():
+    costs = EditCosts()
+    costs.set_confusion("rn", "m", 0.2)
+    d = Dictionary(["maine", "raine"], edit_costs=costs)
+    m = d.best_match("rnaine", 2)
+    assert m["word"] == "maine"
+    assert abs(m["weighted_distance"] - 0.2) < 1e-6
+
+def test_utf8():
+    d = Dictionary(["abbé carton", "abbe"], utf8=True)
+    m = d.best_match("abbe carton", 1)
+    assert m["word"] == "abbé carton"
+    assert m["distance"] == 1
+
+def test_normalization():
+    from FastSpellChecker import Normalization
+    d = Dictionary(["Saint-Denis"], utf8=True, normalization=Normalization.All)
+    m = d.best_match("SAINT DENIS", 0)
+    assert m["word"] == "Saint-Denis"
+
+def test_strip_accents_bytes():
+    # The edits are counted in bytes but the accents of the (UTF-8) Python strings are stripped
+    from FastSpellChecker import Normalization
+    flags = Normalization.StripAccents | Normalization.Lowercase
+    assert flags & Normalization.Lowercase == Normalization.Lowercase
+    assert flags & Normalization.Hyphens == Normalization.NoNormalization
+    d = Dictionary(["élève", "Abbé"], normalization=flags)
+    assert d.best_match("eleve", 0)["word"] == "élève"
+    assert d.best_match("ÉLÈVE", 0)["word"] == "élève"
+    assert d.best_match("abbe", 0)["word"] == "Abbé"
+    assert Dictionary(["Abbé"], normalization=int(flags)).best_match("abbe", 0)["word"] == "Abbé"
+
+def test_correct_text():
+    d = Dictionary(["rue", "de", "la", "paix"])
+    text = "12, rüe de la paiz"
+    corrections = d.correct_text(text, 1)
+    assert [(text[s:e], w) for s, e, w, _ in corrections] == [("paiz", "paix")]
+
+def test_candidates():
+    d = Dictionary(["prout", "pret", "part", "tourte"])
+    c = d.candidates("prt", 1)
+    assert sorted(m["word"] for m in c) == ["part", "pret"]
+
+def test_phrases():
+    from FastSpellChecker import PhraseMatcher
+    p = PhraseMatcher()
+    p.load(["abbe georges henocque", "rue du a"])
+    m = p.best_match("ruedu a", 1, 2)
+    assert m["word"] == "rue du a"
+
+def test_segment():
+    d = Dictionary(["rue", "du", "pont"])
+    assert [w for _, _, w, _ in d.segment("ruedupont")] == ["rue", "du", "pont"]
+    assert d.segment("xyz") is None
+    with pytest.raises(ValueError):
+        d.segment("ruedupont", chars_per_error = 0)
+
+def test_negative_cache():
+    d = Dictionary(["rue", "du", "pont"], negative_cache_capacity = 64)
+    assert d.best_match("xyzxyz") is None
+    assert d.best_match("xyzxyz") is None
+    assert d.negative_cache_stats()["hits"] == 1
+
+def test_stats():
+    d = Dictionary(["a", "ab"])
+    s = d.stats()
+    assert (s["words"], s["keys"], s["postings"]) == (2, 4, 6)
+    assert s["longest_lists"][0] == ("", 2)
+    assert s["bytes"]["total"] > 0
+
+def test_auto_backend():
+    words = ["international business machines", "united nations organization"]
+    assert Dictionary(words, max_distance = 1, backend = Backend.Auto).backend() == Backend.Trie
+    assert Dictionary(words, backend = Backend.Auto).backend() == Backend.HashTable
+    assert Dictionary(words, backend = Backend.Auto, memory_budget = 1000).backend() == Backend.Trie
+
+def test_frozen_backend():
+    d = Dictionary(["prout", "pret", "part", "tourte"], backend = Backend.Frozen)
+    assert d.backend() == Backend.Frozen
+    m = d.best_match("tour", 2)
+    assert (m["word"], m["distance"]) == ("tourte", 2)
+    assert d.has_matches("prt", 1)
+    assert [c["word"] for c in d.candidates("pret", 1)] == ["pret"]
+    assert d.stats()["keys"] == d.stats()["buckets"]
+
+def test_memory_budget():
+    # The longest words are kept out of the index (one by one, the first word would have been indexed)
+    words = ["international business machines", "place de la republique", "rue", "du", "pont"]
+    d = Dictionary(words, memory_budget = 70000)
+    assert d.downgraded_words() == ["international business machines"]
+    assert d.stats()["downgraded"] == 1
+    assert d.best_match("international busines machines", 1)["word"] == "international business machines"
+    assert d.best_match("place de la republiqu", 1)["word"] == "place de la republique"
+
+def test_latency_histogram():
+    slow = []
+    hook = lambda word, d, kind, ns, counters: slow.append((word, kind, set(counters)))
+    d = Dictionary(["rue", "du", "pont"], latency_histograms = True, slow_query_ns = 1, on_slow_query = hook)
+    assert d._options.on_slow_query is hook
+    d.best_match("ruex", 1)
+    assert d.latency_histogram(1, 1)["count"] == 1
+    assert slow == [("ruex", "best_match", {"queries", "variants", "key_hits", "postings", "distance_calls",
+                                            "early_exits"})]
+
+def test_numpy_input():
+    np = pytest.importorskip("numpy")
+    words = np.array(["rue", "du", "pont", "pâté"])
+    d = Dictionary(words, utf8 = True)
+    assert list(d.has_matches_batch(np.array([b"rue", b"pnt", b"xyzxyz"]), 1)) == [True, True, False]
+    assert d.best_match_batch(np.array(["pâte"]), 1)[0]["word"] == "pâté"
+
+    data = np.frombuffer(b"ruedupont", dtype=np.uint8)
+    offsets = np.array([0, 3, 5, 9], dtype=np.int32)
+    d = Dictionary((offsets, data))
+    assert d.has_matches("pont", 0)
+
+def test_numpy_layouts():
+    np = pytest.importorskip("numpy")
+    d = Dictionary(np.array(["rue", "pâté"], dtype=">U4"), utf8 = True)
+    assert d.has_matches("pâté", 0)
+    assert list(d.has_matches_batch(np.array(["pâté", "rue"], dtype="<U4"), 0)) == [True, True]
+
+    data = np.frombuffer(b"rxuxexdxu", dtype=np.uint8)
+    with pytest.raises(RuntimeError):
+        Dictionary((np.array([0, 2], dtype=np.int32), data[::2]))
+    with pytest.raises(RuntimeError):
+        Dictionary((np.array([0, 2], dtype=np.dtype(np.int64).newbyteorder()), data))
+
+def test_columnar_output():
+    np = pytest.importorskip("numpy")
+    d = Dictionary(["rue", "du", "pont"])
+    distance, count, word_id = d.best_match_columns(["rue", "pnt", "xyzxyz"], 1)
+    assert list(distance) == [0, 1, -1]
+    assert list(word_id) == [0, 2, -1]
+    assert d.words(word_id) == ["rue", "pont", None]
+    assert d.word(1) == "du"
+
+def test_batches_from_threads():
+    # The batches run without the GIL
+    np = pytest.importorskip("numpy")
+    from concurrent.futures import ThreadPoolExecutor
+    d = Dictionary(["rue", "du", "pont"])
+    words = np.array(["rue", "pnt", "xyzxyz"] * 1000)
+    with ThreadPoolExecutor(4) as pool:
+        results = list(pool.map(lambda _: d.best_match_columns(words, 1)[0], range(8)))
+    for distance in results:
+        assert list(distance[:3]) == [0, 1, -1]
+    assert d.best_match_batch(words[:2], 1)[1]["word"] == "pont"
+
+def test_load_file(tmp_path):
+    path = tmp_path / "words.txt"
+    path.write_text("rue\npont\n\nrue\nquai")
+    d = Dictionary()
+    d.load_file(path)
+    assert d.has_matches("quai", 0)
+    assert [d.word(i) for i in range(3)] == ["rue", "pont", "quai"]
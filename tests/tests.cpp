@@ -1,7 +1,16 @@
 #include <fsc.hpp>
+#include <fsc_async.hpp>
+#include <fsc_phrase.hpp>
+#include <fsc_segment.hpp>
+#include <fsc_text.hpp>
 
 #include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace std::literals;
 
@@ -80,11 +89,686 @@ TEST(DICO, test_substitutions)
 
 
 
+TEST(DICO, test_transpositions)
+{
+  std::string_view data[] = {"ureu", "rue de la paix", "abc"};
+
+  Dictionary t;
+  t.load(data, 3);
+  ASSERT_EQ(t.best_match("urue", 2).distance, 2);
+  ASSERT_FALSE(t.has_matches("urue", 1));
+
+  DictionaryOptions opts;
+  opts.transpositions = true;
+  Dictionary u(opts);
+  u.load(data, 3);
+
+  {
+    auto m = u.best_match("urue", 1);
+    ASSERT_EQ(m.distance, 1);
+    ASSERT_EQ(m.word, "ureu"sv);
+    ASSERT_TRUE(u.has_matches("urue", 1));
+  }
+
+  {
+    auto m = u.best_match("rue de la apxi", 2);
+    ASSERT_EQ(m.distance, 2);
+    ASSERT_EQ(m.word, "rue de la paix"sv);
+  }
+
+  // Not a transposition
+  ASSERT_EQ(u.best_match("acd", 2).distance, 2);
+  ASSERT_EQ(u.best_match("bac", 2).distance, 1);
+}
+
+
+TEST(DICO, test_edit_costs)
+{
+  std::string_view data[] = {"maine", "raine", "rue de l'abbé"};
+
+  auto costs = std::make_shared<EditCosts>();
+  {
+    std::istringstream table("# OCR confusions\n"
+                             "rn\tm\t0.2\n"
+                             "e\té\t0.1\n");
+    costs->load(table);
+  }
+
+  DictionaryOptions opts;
+  opts.edit_costs = costs;
+  Dictionary t(opts);
+  t.load(data, 3);
+
+  {
+    // "raine" is 1 edit away but "rn" for "m" is cheaper
+    auto m = t.best_match("rnaine", 2);
+    ASSERT_EQ(m.word, "maine"sv);
+    ASSERT_EQ(m.distance, 2);
+    ASSERT_EQ(m.count, 1);
+    ASSERT_FLOAT_EQ(m.weighted_distance, 0.2f);
+  }
+
+  {
+    auto m = t.best_match("rue de l'abbe", 2);
+    ASSERT_EQ(m.word, "rue de l'abbé"sv);
+    ASSERT_FLOAT_EQ(m.weighted_distance, 0.1f);
+  }
+
+  {
+    auto m = t.best_match("maine", 2);
+    ASSERT_EQ(m.distance, 0);
+    ASSERT_FLOAT_EQ(m.weighted_distance, 0.f);
+  }
+
+  ASSERT_EQ(t.best_match("xyzxyz", 2).word, nullptr);
+  ASSERT_THROW(costs->set_confusion("abcde", "a", 0.5f), std::runtime_error);
+
+  // More multi-character confusions than fit on the stack apply at the same position
+  EditCosts many;
+  for (char x = 'a'; x <= 'z'; ++x)
+    for (char y : {'a', 'b', 'c'})
+      many.set_confusion("rn", std::string{x, y}, 0.5f, false);
+  many.set_confusion("rn", "m", 0.1f, false);
+  ASSERT_FLOAT_EQ(many.weighted_distance("rnat", "mat", 10.f), 0.1f);
+}
+
+TEST(DICO, test_normalization)
+{
+  ASSERT_EQ(normalize("  Rue  de l'ÉPÉE-Saint_Jacques ", Normalization::All, true), "rue de l'epee saint jacques");
+  ASSERT_EQ(normalize("ABCDEFGHIJKLMNOPQRSTUVWXYZ[@`{", Normalization::Lowercase), "abcdefghijklmnopqrstuvwxyz[@`{");
+  ASSERT_EQ(normalize("\xC9l\xE8ve", Normalization::StripAccents), "Eleve"); // Latin-1
+  ASSERT_EQ(normalize("Łódź œuvre", Normalization::StripAccents, true), "Lodz œuvre");
+  ASSERT_EQ(normalize("e\xCC\x81t\xC3\xA9", Normalization::StripAccents, true), "ete"); // Combining acute accent
+
+  std::string_view data[] = {"Saint-Denis", "Abbé Grégoire"};
+
+  DictionaryOptions opts;
+  opts.utf8          = true;
+  opts.normalization = Normalization::All;
+  Dictionary t(opts);
+  t.load(data, 2);
+
+  {
+    auto m = t.best_match("saint denis", 2);
+    ASSERT_EQ(m.distance, 0);
+    ASSERT_EQ(m.word, "Saint-Denis"sv);
+  }
+
+  {
+    auto m = t.best_match("ABBE  GREGOIRE", 0);
+    ASSERT_EQ(m.distance, 0);
+    ASSERT_EQ(m.word, "Abbé Grégoire"sv);
+  }
+
+  ASSERT_TRUE(t.has_matches("abbe gregoir", 1));
+
+  // UTF-8 words with the edits counted in bytes
+  opts.utf8               = false;
+  opts.utf8_normalization = true;
+  Dictionary b(opts);
+  b.load(data, 2);
+  ASSERT_EQ(b.best_match("abbe gregoire", 0).word, "Abbé Grégoire"sv);
+  ASSERT_EQ(b.best_match("Abbé Grégoire", 0).word, "Abbé Grégoire"sv);
+}
+
+namespace
+{
+  struct CollectOutput : TextCorrector::Output
+  {
+    void on_token(const TextCorrection& c) override
+    {
+      tokens.emplace_back(c.token);
+      offsets.push_back(c.offset);
+      words.emplace_back(c.match.distance <= 1 ? c.match.word : "");
+    }
+
+    std::vector<std::string> tokens;
+    std::vector<std::size_t> offsets;
+    std::vector<std::string> words;
+  };
+}
+
+TEST(DICO, test_correct_text)
+{
+  std::string_view data[] = {"rue", "de", "la", "paix", "saint-martin", "faubourg"};
+  Dictionary       t;
+  t.load(data, 6);
+
+  std::string_view text = "12, rue de la paiz; faubourg saint-matin (2e) -- xyzzy";
+
+  CollectOutput out;
+  correct_text(t, text, 1, out);
+
+  std::vector<std::string> tokens = {"rue", "de", "la", "paiz", "faubourg", "saint-matin", "xyzzy"};
+  std::vector<std::string> words  = {"rue", "de", "la", "paix", "faubourg", "saint-martin", ""};
+  ASSERT_EQ(out.tokens, tokens);
+  ASSERT_EQ(out.words, words);
+  for (std::size_t i = 0; i < tokens.size(); ++i)
+    ASSERT_EQ(text.substr(out.offsets[i], tokens[i].size()), tokens[i]);
+
+  // Same result whatever the chunking
+  for (std::size_t chunk_size : {1, 2, 3, 7})
+  {
+    CollectOutput chunked;
+    TextCorrector c(t, 1);
+    for (std::size_t i = 0; i < text.size(); i += chunk_size)
+      c.feed(text.substr(i, chunk_size), chunked);
+    c.finish(chunked);
+
+    ASSERT_EQ(chunked.tokens, out.tokens) << chunk_size;
+    ASSERT_EQ(chunked.offsets, out.offsets) << chunk_size;
+  }
+
+  // A long run without separator fed byte by byte is scanned once (it is skipped, too long for a word)
+  std::string   run(1 << 20, 'a');
+  CollectOutput long_run;
+  TextCorrector c(t, 1);
+  for (char x : run + " rue")
+    c.feed({&x, 1}, long_run);
+  c.finish(long_run);
+  ASSERT_EQ(long_run.tokens, std::vector<std::string>{"rue"});
+  ASSERT_EQ(long_run.offsets, std::vector<std::size_t>{run.size() + 1});
+}
+
+// UTF-8 punctuation separates the tokens
+TEST(DICO, test_correct_text_utf8)
+{
+  std::string_view data[] = {"rue", "église", "l", "été", "saint-éloi"};
+  Dictionary       t;
+  t.load(data, 5);
+
+  std::string_view text = "«\u00A0rue\u00A0» l’église… l'été—saint-éloi ½ µm";
+
+  CollectOutput out;
+  correct_text(t, text, 1, out);
+
+  std::vector<std::string> tokens = {"rue", "l", "église", "l", "été", "saint-éloi", "µm"};
+  ASSERT_EQ(out.tokens, tokens);
+  for (std::size_t i = 0; i < tokens.size(); ++i)
+    ASSERT_EQ(text.substr(out.offsets[i], tokens[i].size()), tokens[i]);
+
+  // The chunks cut the UTF-8 sequences
+  for (std::size_t chunk_size : {1, 2, 3, 5})
+  {
+    CollectOutput chunked;
+    TextCorrector c(t, 1);
+    for (std::size_t i = 0; i < text.size(); i += chunk_size)
+      c.feed(text.substr(i, chunk_size), chunked);
+    c.finish(chunked);
+
+    ASSERT_EQ(chunked.tokens, out.tokens) << chunk_size;
+    ASSERT_EQ(chunked.offsets, out.offsets) << chunk_size;
+  }
+
+  // Latin-1 letters are still letters
+  CollectOutput latin1;
+  correct_text(t, "\xE9t\xE9, rue", 1, latin1);
+  ASSERT_EQ(latin1.tokens, (std::vector<std::string>{"\xE9t\xE9", "rue"}));
+}
+
+TEST(DICO, test_candidates)
+{
+  std::string_view data[] = {"prout", "pret", "part", "tourte"};
+  Dictionary       t;
+  t.load(data, 4);
+
+  auto c = t.candidates("prt", 2);
+  ASSERT_EQ(c.size(), 3u);
+  ASSERT_EQ(c[0].distance, 1);
+  ASSERT_EQ(c[1].distance, 1);
+  ASSERT_EQ(c[2].distance, 2);
+  ASSERT_EQ(c[2].word, "prout"sv);
+  ASSERT_EQ(c[0].word, "part"sv); // Ties by spelling
+  ASSERT_EQ(c[1].word, "pret"sv);
+
+  ASSERT_EQ(edit_distance("ureu", "urue"), 2);
+  ASSERT_EQ(edit_distance("ureu", "urue", true), 1);
+  ASSERT_EQ(edit_distance("abbé", "abbe", false, true), 1);
+}
+
+TEST(DICO, test_phrases)
+{
+  std::string_view data[] = {"abbe georges henocque", "rue du a", "faubourg saint-martin", "abbe gregoire"};
+
+  PhraseMatcher t;
+  t.load(data, 4);
+
+  {
+    // Too far for the whole-string index
+    auto m = t.best_match("abe gorges henoque", 1, 4);
+    ASSERT_EQ(m.word, "abbe georges henocque"sv);
+    ASSERT_EQ(m.distance, 3);
+    ASSERT_EQ(m.count, 1);
+  }
+
+  {
+    // Merged and split words
+    auto m = t.best_match("ruedu a", 1, 2);
+    ASSERT_EQ(m.word, "rue du a"sv);
+    ASSERT_EQ(m.distance, 1);
+
+    m = t.best_match("abbegeorges hen ocque", 1, 2);
+    ASSERT_EQ(m.word, "abbe georges henocque"sv);
+    ASSERT_EQ(m.distance, 2);
+  }
+
+  ASSERT_EQ(t.best_match("faubourg saint-martin", 0, 0).distance, 0);
+  ASSERT_EQ(t.best_match("xyz", 2, 2).word, nullptr);
+
+  // Tokens (and pairs of tokens) too long to be compared do not match
+  std::string long_token(200, 'x');
+  auto        m = t.best_match("rue du " + long_token + " " + long_token + " a", 1, 1000);
+  ASSERT_EQ(m.word, "rue du a"sv);
+  ASSERT_EQ(t.best_match(std::string(300, 'y') + " rue du a", 1, 1000).word, "rue du a"sv);
+
+  // The phrases are added one by one
+  DictionaryOptions frozen;
+  frozen.backend = DictionaryBackend::Frozen;
+  ASSERT_THROW(PhraseMatcher{frozen}, std::runtime_error);
+}
+
+TEST(DICO, test_segmentation)
+{
+  std::string_view data[] = {"rue", "du", "pont", "neuf", "de", "la", "paix", "chaussee", "antin"};
+  Dictionary       t;
+  t.load(data, 9);
+  ASSERT_EQ(t.longest_word_length(), 8);
+
+  auto words = [](const Segmentation& s) {
+    std::vector<std::string> r;
+    for (const auto& x : s.segments)
+      r.emplace_back(x.match.word);
+    return r;
+  };
+
+  {
+    auto s = segment(t, "ruedupontneuf", 2, 2);
+    ASSERT_EQ(s.distance, 0);
+    ASSERT_EQ(words(s), (std::vector<std::string>{"rue", "du", "pont", "neuf"}));
+    ASSERT_EQ(s.segments[2].offset, 5u);
+    ASSERT_EQ(s.segments[2].length, 4u);
+  }
+
+  {
+    auto s = segment(t, "ruedelapaixchausseeantn", 2, 2);
+    ASSERT_EQ(s.distance, 1);
+    ASSERT_EQ(words(s), (std::vector<std::string>{"rue", "de", "la", "paix", "chaussee", "antin"}));
+  }
+
+  // Short segments must be exact and the budget is respected
+  ASSERT_TRUE(segment(t, "ruxdu", 2, 2).segments.empty());
+  ASSERT_TRUE(segment(t, "chausseantn", 2, 1).segments.empty());
+  ASSERT_EQ(segment(t, "chausseantn", 2, 2).distance, 2);
+
+  ASSERT_EQ(segment(t, "ruxdu", 2, 2, 1).distance, 1);
+  ASSERT_THROW(segment(t, "ruedu", 2, 2, 0), std::invalid_argument);
+  ASSERT_THROW(segment(t, "ruedu", 2, 2, -1), std::invalid_argument);
+}
 
 
 extern std::string_view test_data[];
 extern std::size_t test_data_size;
 
+
+TEST(Dico, cache)
+{
+  DictionaryOptions opts;
+  opts.cache_capacity = 1000;
+  opts.normalization  = Normalization::Lowercase;
+
+  Dictionary ref;
+  Dictionary t(opts);
+  ref.load(test_data, test_data_size);
+  t.load(test_data, test_data_size);
+
+  for (int k = 0; k < 3; ++k)
+  {
+    for (std::size_t i = 0; i < 300; i += 3)
+    {
+      auto w = test_data[i].substr(1);
+      auto a = ref.best_match(w, 2);
+      auto b = t.best_match(w, 2);
+      ASSERT_EQ(a.distance, b.distance) << w;
+      ASSERT_EQ(a.count, b.count) << w;
+      ASSERT_EQ(ref.has_matches(w, 1), t.has_matches(w, 1)) << w;
+    }
+  }
+
+  auto s = t.cache_stats();
+  ASSERT_EQ(s.capacity, 1000u);
+  ASSERT_EQ(s.size, 200u);
+  ASSERT_EQ(s.hits + s.misses, 600u);
+  ASSERT_EQ(s.hits, 400u);
+
+  // Keyed by the normalized word
+  ASSERT_EQ(t.best_match("ABBE", 2).distance, t.best_match("abbe", 2).distance);
+  ASSERT_EQ(t.cache_stats().hits, s.hits + 1);
+
+  // Invalidated by add_word
+  ASSERT_FALSE(t.has_matches("qwertyuiop", 0));
+  t.add_word("qwertyuiop");
+  ASSERT_TRUE(t.has_matches("qwertyuiop", 0));
+}
+
+TEST(Dico, query_counters)
+{
+  if (!query_counters_enabled())
+    GTEST_SKIP() << "Built without FSC_QUERY_COUNTERS";
+
+  Dictionary t;
+  std::string_view data[] = {"rue", "ruelle", "pont"};
+  t.load(data, 3);
+
+  reset_thread_query_counters();
+  t.best_match("rue", 2);
+  auto exact = last_query_counters();
+  ASSERT_EQ(exact.queries, 1u);
+  ASSERT_EQ(exact.variants, 1u); // The exact match ends the search
+  ASSERT_EQ(exact.key_hits, 1u);
+  ASSERT_GE(exact.early_exits, 1u);
+
+  t.best_match("ruex", 2);
+  auto fuzzy = last_query_counters();
+  ASSERT_GT(fuzzy.variants, 1u);
+  ASSERT_GE(fuzzy.postings, fuzzy.key_hits);
+  ASSERT_GT(fuzzy.distance_calls, 0u);
+
+  auto total = thread_query_counters();
+  ASSERT_EQ(total.queries, 2u);
+  ASSERT_EQ(total.variants, exact.variants + fuzzy.variants);
+
+  // Per thread
+  std::thread([] { ASSERT_EQ(thread_query_counters().queries, 0u); }).join();
+}
+
+TEST(Dico, latency_histograms)
+{
+  ASSERT_EQ(LatencyHistogram::bucket_of(7), 7);
+  ASSERT_EQ(LatencyHistogram::bucket_upper_bound(LatencyHistogram::bucket_of(1000)) / 1000, 1u);
+  for (std::uint64_t ns : {9ull, 100ull, 12345ull, 1ull << 40})
+  {
+    auto b = LatencyHistogram::bucket_of(ns);
+    ASSERT_LE(ns, LatencyHistogram::bucket_upper_bound(b));
+    ASSERT_GT(ns, LatencyHistogram::bucket_upper_bound(b - 1));
+    ASSERT_LE(LatencyHistogram::bucket_upper_bound(b), ns + ns / 8);
+  }
+  ASSERT_EQ(length_class(3), 0);
+  ASSERT_EQ(length_class(15), 2);
+  ASSERT_EQ(length_class(255), kNumLengthClasses - 1);
+
+  std::vector<std::string> slow;
+
+  DictionaryOptions opts;
+  opts.latency_histograms = true;
+  opts.slow_query_ns      = 1;
+  opts.on_slow_query      = [&](const SlowQuery& q) { slow.emplace_back(q.word); };
+
+  Dictionary t(opts);
+  t.load(test_data, test_data_size);
+  for (int i = 0; i < 10; ++i)
+    t.best_match("petites-ecuries", 2);
+  t.has_matches("rue", 1);
+
+  auto h = t.latency_histogram(2, length_class(15));
+  ASSERT_EQ(h.count(), 10u);
+  ASSERT_GT(h.percentile(50), 0u);
+  ASSERT_LE(h.percentile(50), h.percentile(99));
+  ASSERT_EQ(t.latency_histogram(1, 0).count(), 1u);
+  ASSERT_EQ(t.latency_histogram(0, 0).count(), 0u);
+  ASSERT_EQ(slow.size(), 11u);
+  ASSERT_EQ(slow.back(), "rue");
+
+  t.reset_latency_histograms();
+  ASSERT_EQ(t.latency_histogram(2, length_class(15)).count(), 0u);
+
+  // Disabled
+  Dictionary u;
+  u.load(test_data, test_data_size);
+  u.best_match("rue", 1);
+  ASSERT_EQ(u.latency_histogram(1, 0).count(), 0u);
+  ASSERT_THROW(u.latency_histogram(3, 0), std::runtime_error);
+}
+
+TEST(Dico, word_ids)
+{
+  DictionaryOptions opts;
+  opts.normalization = Normalization::Lowercase;
+
+  Dictionary t(opts);
+  std::string_view data[] = {"Rue", "pont", "rue", "quai"};
+  t.load(data, 4);
+
+  ASSERT_EQ(t.num_words(), 3u);
+  ASSERT_STREQ(t.word(0), "Rue");
+  ASSERT_STREQ(t.word(2), "quai");
+  ASSERT_THROW(t.word(3), std::runtime_error);
+
+  auto m = t.best_match("RUE", 0);
+  ASSERT_EQ(t.word_id(m.word), 0u);
+  ASSERT_EQ(t.word_id(t.best_match("pond", 1).word), 1u);
+  ASSERT_EQ(t.word_id(t.best_match("xxxxxxx", 1).word), Dictionary::kNoWord);
+
+  t.add_word("Quai");
+  t.add_word("gare");
+  ASSERT_EQ(t.num_words(), 4u);
+  ASSERT_EQ(t.word_id(t.best_match("gare", 0).word), 3u);
+}
+
+TEST(Dico, load_file)
+{
+  auto path = std::filesystem::temp_directory_path() / "fsc_load_file.txt";
+  {
+    std::ofstream f(path, std::ios::binary);
+    f << "rue\r\npont  \n\nquai\nrue\n";
+    for (int k = 0; k < 40; ++k) // Big enough (> 2MB) to be split in chunks
+      for (std::size_t i = 0; i < test_data_size; ++i)
+        f << test_data[i] << '\n';
+    f << "gare"; // No final newline
+  }
+
+  Dictionary t;
+  t.load_file(path.string());
+  ASSERT_STREQ(t.word(0), "rue");
+  ASSERT_STREQ(t.word(1), "pont");
+  ASSERT_STREQ(t.word(2), "quai");
+  ASSERT_TRUE(t.has_matches("gare", 0));
+  ASSERT_FALSE(t.has_matches("", 0));
+
+  DictionaryOptions opts;
+  opts.backend = DictionaryBackend::Sharded;
+  Dictionary u(opts);
+  u.load_file(path.string(), 4);
+  ASSERT_EQ(u.num_words(), t.num_words());
+  for (std::size_t i = 0; i < test_data_size; i += 7)
+    ASSERT_TRUE(u.has_matches(test_data[i], 0)) << test_data[i];
+  ASSERT_EQ(u.best_match("petites-ecuries", 2).distance, 1);
+
+  std::filesystem::remove(path);
+  ASSERT_THROW(t.load_file(path.string()), std::runtime_error);
+}
+
+TEST(Dico, async)
+{
+  Dictionary t;
+  t.load(test_data, test_data_size);
+
+  {
+    AsyncOptions opts;
+    opts.num_threads    = 4;
+    opts.queue_capacity = 8; // Smaller than the number of queries (submit waits)
+
+    AsyncDictionary async(t, opts);
+    std::vector<std::future<DictionaryMatch>> results;
+    for (std::size_t i = 0; i < test_data_size; i += 50)
+      results.push_back(async.best_match(std::string(test_data[i]) + "x", 1));
+
+    for (std::size_t i = 0, k = 0; i < test_data_size; i += 50, ++k)
+      ASSERT_EQ(results[k].get().distance, t.best_match(std::string(test_data[i]) + "x", 1).distance);
+
+    ASSERT_TRUE(async.has_matches("petites-ecuries", 1).get());
+    ASSERT_EQ(async.candidates("petites-ecuries", 1).get().size(), 1u);
+    ASSERT_THROW(async.best_match("rue", 3).get(), std::runtime_error);
+  }
+
+  // Backpressure: the single worker is blocked, so the queue fills up
+  {
+    std::promise<void> release;
+    auto               blocked = release.get_future().share();
+
+    DictionaryOptions dopts;
+    dopts.latency_histograms = true;
+    dopts.slow_query_ns      = 1;
+    dopts.on_slow_query      = [blocked](const SlowQuery&) { blocked.wait(); };
+    Dictionary u(dopts);
+    u.load(test_data, test_data_size);
+
+    AsyncOptions opts;
+    opts.num_threads    = 1;
+    opts.queue_capacity = 2;
+    AsyncDictionary async(u, opts);
+
+    auto first = async.try_best_match("rue", 0);
+    ASSERT_TRUE(first.has_value());
+    while (async.queue_size() != 0) // Wait for the worker to take it
+      std::this_thread::yield();
+
+    auto second = async.try_has_matches("rue", 0);
+    auto third  = async.try_has_matches("rue", 0);
+    ASSERT_TRUE(second && third);
+    ASSERT_FALSE(async.try_best_match("rue", 0).has_value());
+    ASSERT_EQ(async.queue_size(), 2u);
+
+    release.set_value();
+    ASSERT_TRUE(second->get());
+  }
+}
+
+TEST(Dico, stats)
+{
+  for (auto backend : {DictionaryBackend::HashTable, DictionaryBackend::Sharded})
+  {
+    DictionaryOptions opts;
+    opts.backend = backend;
+
+    Dictionary t(opts);
+    std::string_view data[] = {"a", "ab"};
+    t.load(data, 2);
+
+    // Keys: a (2 postings), "" (2), ab, b
+    auto s = t.stats();
+    ASSERT_EQ(s.words, 2u);
+    ASSERT_EQ(s.keys, 4u);
+    ASSERT_EQ(s.postings, 6u);
+    ASSERT_EQ(s.keys_by_length, (std::vector<std::size_t>{1, 2, 1}));
+    ASSERT_EQ(s.lists_by_log2_size, (std::vector<std::size_t>{2, 2}));
+    ASSERT_EQ(s.longest_lists.size(), 4u);
+    ASSERT_EQ(s.longest_lists[0], (std::pair<std::string, std::size_t>{"", 2}));
+    ASSERT_EQ(s.longest_lists[1], (std::pair<std::string, std::size_t>{"a", 2}));
+    ASSERT_GT(s.load_factor, 0);
+    ASSERT_GE(s.posting_bytes, 6 * sizeof(void*));
+    ASSERT_GT(s.total_bytes(), s.posting_bytes);
+  }
+
+  Dictionary t;
+  t.load(test_data, test_data_size);
+  auto s = t.stats();
+  ASSERT_EQ(s.words, test_data_size);
+  ASSERT_EQ(s.longest_lists.size(), (std::size_t)IndexStats::kNumLongestLists);
+  ASSERT_GE(s.longest_lists[0].second, s.longest_lists[9].second);
+  ASSERT_EQ(s.keys_by_length.size(), (std::size_t)t.longest_word_length() + 1);
+}
+
+TEST(Dico, negative_cache)
+{
+  DictionaryOptions opts;
+  opts.negative_cache_capacity = 1024;
+
+  Dictionary t(opts);
+  t.load(test_data, test_data_size);
+
+  for (int k = 0; k < 2; ++k)
+  {
+    ASSERT_FALSE(t.has_matches("s-ecuries", 2));
+    ASSERT_FALSE(t.has_matches("s-ecuries", 1)); // Known from the miss at d=2
+    ASSERT_EQ(t.best_match("1234567", 2).word, nullptr);
+    ASSERT_TRUE(t.has_matches("petites-ecuries", 1));
+  }
+
+  auto s = t.negative_cache_stats();
+  ASSERT_EQ(s.size, 2u);
+  ASSERT_EQ(s.hits, 4u);
+
+  // A miss at d=1 says nothing about d=2
+  ASSERT_FALSE(t.has_matches("abbe gregoirexx", 1));
+  ASSERT_TRUE(t.has_matches("abbe gregoirexx", 2));
+
+  // Invalidated by add_word
+  t.add_word("1234567");
+  ASSERT_EQ(t.best_match("1234567", 2).distance, 0);
+  ASSERT_TRUE(t.has_matches("s-ecurie", 2) == false);
+  t.add_word("s-ecurie");
+  ASSERT_TRUE(t.has_matches("s-ecuries", 1));
+}
+
+
+TEST(Dico, utf8)
+{
+  std::string_view data[] = {"abbé carton", "rue de l'épée", "émile zola", "abbe"};
+
+  {
+    // Bytes: "é" is 2 edits away from "e"
+    Dictionary t;
+    t.load(data, 4);
+    ASSERT_EQ(t.best_match("abbe carton", 2).distance, 2);
+  }
+
+  DictionaryOptions opts;
+  opts.utf8 = true;
+  Dictionary t(opts);
+  t.load(data, 4);
+
+  {
+    auto m = t.best_match("abbe carton", 1);
+    ASSERT_EQ(m.distance, 1);
+    ASSERT_EQ(m.word, "abbé carton"sv);
+  }
+
+  {
+    auto m = t.best_match("rue de l'epee", 2);
+    ASSERT_EQ(m.distance, 2);
+    ASSERT_EQ(m.word, "rue de l'épée"sv);
+  }
+
+  {
+    auto m = t.best_match("émile zolà", 2);
+    ASSERT_EQ(m.distance, 1);
+    ASSERT_EQ(m.count, 1);
+  }
+
+  {
+    auto m = t.best_match("abbé", 2);
+    ASSERT_EQ(m.distance, 1);
+    ASSERT_EQ(m.word, "abbe"sv);
+  }
+
+  ASSERT_TRUE(t.has_matches("mile zola", 1));
+  ASSERT_TRUE(t.has_matches("ébbé carton", 1));
+}
+
+TEST(Dico, utf8_large_data)
+{
+  DictionaryOptions opts;
+  opts.utf8 = true;
+  Dictionary t(opts);
+  t.load(test_data, test_data_size);
+
+  for (std::size_t i = 0; i < test_data_size; i += 11)
+    ASSERT_TRUE(t.has_matches(test_data[i], 0)) << test_data[i];
+
+  ASSERT_EQ(t.best_match("adolphe cherioux", 2).distance, 1);
+  ASSERT_EQ(t.best_match("etienne dolet", 2).distance, 1);
+}
+
 TEST(Dico, large_data)
 {
   Dictionary t;
@@ -105,3 +789,326 @@ TEST(Dico, large_data)
     ASSERT_FALSE(t.has_matches("s-ecuries", 2));
   }
 }
+
+
+TEST(Dico, sharded)
+{
+  DictionaryOptions opts;
+  opts.backend    = DictionaryBackend::Sharded;
+  opts.num_shards = 8;
+
+  Dictionary ref;
+  Dictionary t(opts);
+  ref.load(test_data, test_data_size);
+  t.load(test_data, test_data_size);
+
+  for (auto w : {"petites-ecuries"sv, "s-ecuries"sv, "abbe gregoir"sv, "rue du a"sv, "xyz"sv})
+  {
+    for (int d = 0; d <= 2; ++d)
+    {
+      auto a = ref.best_match(w, d);
+      auto b = t.best_match(w, d);
+      ASSERT_EQ(a.distance, b.distance) << w << " d=" << d;
+      ASSERT_EQ(a.count, b.count) << w << " d=" << d;
+      ASSERT_EQ(ref.has_matches(w, d), t.has_matches(w, d)) << w << " d=" << d;
+    }
+  }
+}
+
+TEST(Dico, sharded_concurrent_add_word)
+{
+  DictionaryOptions opts;
+  opts.backend = DictionaryBackend::Sharded;
+
+  Dictionary t(opts);
+  t.load(test_data, test_data_size / 2);
+
+  std::thread writer([&] {
+    for (std::size_t i = test_data_size / 2; i < test_data_size; ++i)
+      t.add_word(test_data[i]);
+  });
+
+  std::vector<std::thread> readers;
+  for (int k = 0; k < 4; ++k)
+    readers.emplace_back([&] {
+      for (std::size_t i = 0; i < test_data_size / 2; i += 7)
+        ASSERT_TRUE(t.has_matches(test_data[i], 0));
+    });
+
+  writer.join();
+  for (auto& r : readers)
+    r.join();
+
+  for (std::size_t i = 0; i < test_data_size; i += 13)
+    ASSERT_EQ(t.best_match(test_data[i], 2).distance, 0) << test_data[i];
+}
+
+TEST(Dico, trie_backend)
+{
+  for (bool transpositions : {false, true})
+  {
+    DictionaryOptions opts;
+    opts.transpositions = transpositions;
+    opts.exact_count    = true;
+    Dictionary hash(opts);
+    opts.backend = DictionaryBackend::Trie;
+    Dictionary trie(opts);
+    hash.load(test_data, test_data_size);
+    trie.load(test_data, test_data_size);
+
+    ASSERT_EQ(trie.num_words(), hash.num_words());
+    ASSERT_LT(trie.stats().total_bytes() * 10, hash.stats().total_bytes());
+
+    // Substitutions, swaps and deletions of the test words
+    for (std::size_t i = 0; i < test_data_size; i += 37)
+    {
+      std::string q(test_data[i]);
+      if (q.size() > 2)
+      {
+        std::swap(q[0], q[1]);
+        q[q.size() / 2] = 'z';
+        if (i % 2)
+          q.pop_back();
+      }
+      for (int d = 0; d <= 2; ++d)
+      {
+        auto a = hash.best_match(q, d);
+        auto b = trie.best_match(q, d);
+        ASSERT_EQ(a.distance <= d, b.distance <= d) << q << " d=" << d;
+        if (a.distance <= d)
+        {
+          ASSERT_EQ(a.distance, b.distance) << q << " d=" << d;
+          ASSERT_EQ(a.count, b.count) << q << " d=" << d;
+        }
+        ASSERT_EQ(hash.candidates(q, d).size(), trie.candidates(q, d).size()) << q << " d=" << d;
+        ASSERT_EQ(hash.has_matches(q, d), trie.has_matches(q, d)) << q << " d=" << d;
+      }
+    }
+  }
+
+  // Normalized words keep their spelling, and add_word after load
+  DictionaryOptions opts;
+  opts.backend       = DictionaryBackend::Trie;
+  opts.normalization = Normalization::Lowercase;
+  Dictionary t(opts);
+  std::string_view data[] = {"Paris", "Lyon"};
+  t.load(data, 2);
+  t.add_word("Nice");
+  ASSERT_STREQ(t.best_match("pari", 1).word, "Paris");
+  ASSERT_STREQ(t.best_match("NICE", 0).word, "Nice");
+  ASSERT_EQ(t.word_id(t.best_match("lyon", 0).word), 1u);
+
+  opts.utf8 = true;
+  ASSERT_THROW(Dictionary{opts}, std::runtime_error);
+}
+
+TEST(Dico, auto_backend)
+{
+  Dictionary hash;
+  hash.load(test_data, test_data_size);
+  auto hash_bytes = hash.stats().total_bytes();
+
+  DictionaryOptions opts;
+  opts.backend = DictionaryBackend::Auto;
+  {
+    Dictionary t(opts);
+    ASSERT_EQ(t.backend(), DictionaryBackend::HashTable);
+    t.load(test_data, test_data_size);
+    ASSERT_EQ(t.backend(), DictionaryBackend::HashTable);
+  }
+
+  // The estimate is close enough to the actual size
+  opts.memory_budget = hash_bytes * 2;
+  {
+    Dictionary t(opts);
+    t.load(test_data, test_data_size);
+    ASSERT_EQ(t.backend(), DictionaryBackend::HashTable);
+  }
+  opts.memory_budget = hash_bytes / 2;
+  {
+    Dictionary t(opts);
+    t.add_word("before");
+    t.load(test_data, test_data_size);
+    ASSERT_EQ(t.backend(), DictionaryBackend::Trie);
+    ASSERT_LT(t.stats().total_bytes(), opts.memory_budget);
+    ASSERT_EQ(t.best_match(test_data[0], 0).distance, 0);
+    ASSERT_FALSE(t.has_matches("before", 0));
+
+    // A smaller list fits again
+    t.load(test_data, 10);
+    ASSERT_EQ(t.backend(), DictionaryBackend::HashTable);
+  }
+
+  // The trie does not count the edits in UTF-8
+  opts.utf8 = true;
+  {
+    Dictionary t(opts);
+    t.load(test_data, test_data_size);
+    ASSERT_EQ(t.backend(), DictionaryBackend::HashTable);
+  }
+
+  // Long words queried at distance 1
+  std::vector<std::string> long_words = {"international business machines", "united nations organization"};
+  std::vector<std::string_view> views(long_words.begin(), long_words.end());
+  opts               = {};
+  opts.backend       = DictionaryBackend::Auto;
+  opts.max_distance  = 1;
+  Dictionary t(opts);
+  t.load(views.data(), views.size());
+  ASSERT_EQ(t.backend(), DictionaryBackend::Trie);
+  ASSERT_EQ(t.best_match("united nation organization", 1).distance, 1);
+}
+
+TEST(Dico, frozen_backend)
+{
+  for (bool utf8 : {false, true})
+  {
+    DictionaryOptions opts;
+    opts.utf8        = utf8;
+    opts.exact_count = true;
+    Dictionary hash(opts);
+    opts.backend = DictionaryBackend::Frozen;
+    Dictionary frozen(opts);
+    hash.load(test_data, test_data_size);
+    frozen.load(test_data, test_data_size);
+
+    auto a = hash.stats(), b = frozen.stats();
+    ASSERT_EQ(frozen.num_words(), hash.num_words());
+    ASSERT_EQ(b.words, a.words);
+    ASSERT_EQ(b.keys, a.keys);
+    ASSERT_EQ(b.postings, a.postings);
+    ASSERT_LT(b.total_bytes(), a.total_bytes());
+
+    for (std::size_t i = 0; i < test_data_size; i += 11)
+    {
+      std::string q(test_data[i]);
+      if (q.size() > 2)
+      {
+        q[q.size() / 2] = 'z';
+        if (i % 2)
+          q.erase(0, 1);
+      }
+      for (int d = 0; d <= 2; ++d)
+      {
+        auto x = hash.best_match(q, d);
+        auto y = frozen.best_match(q, d);
+        ASSERT_EQ(x.distance, y.distance) << q << " d=" << d;
+        ASSERT_EQ(x.count, y.count) << q << " d=" << d;
+        if (x.distance <= d)
+        {
+          ASSERT_STREQ(x.word, y.word) << q << " d=" << d;
+        }
+        ASSERT_EQ(hash.candidates(q, d).size(), frozen.candidates(q, d).size()) << q << " d=" << d;
+        ASSERT_EQ(hash.has_matches(q, d), frozen.has_matches(q, d)) << q << " d=" << d;
+      }
+    }
+
+    // The words are only added by load
+    ASSERT_THROW(frozen.add_word("hello"), std::runtime_error);
+  }
+
+  // Empty dictionary, and a reload
+  DictionaryOptions opts;
+  opts.backend = DictionaryBackend::Frozen;
+  Dictionary t(opts);
+  std::string_view data[] = {"paris", "lyon"};
+  t.load(data, 0);
+  ASSERT_FALSE(t.has_matches("paris", 2));
+  t.load(data, 2);
+  ASSERT_STREQ(t.best_match("pari", 1).word, "paris");
+  ASSERT_EQ(t.num_words(), 2u);
+  ASSERT_EQ(t.stats().keys, t.stats().buckets);
+}
+
+TEST(Dico, memory_budget)
+{
+  DictionaryOptions opts;
+  opts.exact_count = true;
+  Dictionary full(opts);
+  full.load(test_data, test_data_size);
+  auto full_bytes = full.stats().total_bytes();
+
+  opts.memory_budget = full_bytes / 4;
+  Dictionary t(opts);
+  t.load(test_data, test_data_size);
+  auto s          = t.stats();
+  auto downgraded = t.downgraded_words();
+  ASSERT_EQ(t.num_words(), test_data_size);
+  ASSERT_GT(s.downgraded, 0u);
+  ASSERT_EQ(s.downgraded, downgraded.size());
+  ASSERT_EQ(s.words + s.downgraded, test_data_size);
+  ASSERT_LT(s.total_bytes(), opts.memory_budget * 1.2);
+
+  // The downgraded words are the longest ones
+  std::size_t shortest = SIZE_MAX;
+  for (const auto& w : downgraded)
+    shortest = std::min(shortest, w.size());
+  for (std::size_t i = 0; i < test_data_size; ++i)
+  {
+    if (test_data[i].size() > shortest)
+    {
+      ASSERT_NE(std::find(downgraded.begin(), downgraded.end(), test_data[i]), downgraded.end()) << test_data[i];
+    }
+  }
+
+  // Same results as the full index
+  for (std::size_t i = 0; i < test_data_size; i += 7)
+  {
+    std::string q(test_data[i]);
+    if (q.size() > 3)
+    {
+      q[1] = 'z';
+      q.erase(q.size() - 2, 1);
+    }
+    for (int d = 0; d <= 2; ++d)
+    {
+      auto a = full.best_match(q, d);
+      auto b = t.best_match(q, d);
+      ASSERT_EQ(a.distance <= d, b.distance <= d) << q << " d=" << d;
+      if (a.distance <= d)
+      {
+        ASSERT_EQ(a.distance, b.distance) << q << " d=" << d;
+        ASSERT_EQ(a.count, b.count) << q << " d=" << d;
+      }
+      ASSERT_EQ(full.candidates(q, d).size(), t.candidates(q, d).size()) << q << " d=" << d;
+    }
+  }
+
+  // Words added beyond the budget, an indexed word added again stays in the index
+  t.add_word("supercalifragilisticexpialidocious");
+  ASSERT_EQ(t.downgraded_words().size(), downgraded.size() + 1);
+  ASSERT_STREQ(t.best_match("supercalifragilisticexpialidociou", 1).word, "supercalifragilisticexpialidocious");
+  std::string_view indexed = test_data[0];
+  for (std::size_t i = 0; i < test_data_size; ++i)
+    if (test_data[i].size() < indexed.size())
+      indexed = test_data[i];
+  opts.memory_budget = 1;
+  Dictionary small(opts);
+  small.load(&indexed, 0);
+  small.add_word("a");
+  ASSERT_EQ(small.downgraded_words(), std::vector<std::string>{"a"});
+  small.add_word("a");
+  ASSERT_EQ(small.num_words(), 1u);
+  ASSERT_EQ(small.stats().downgraded, 1u);
+}
+
+// The Sharded load holds all the shards while it checks the words kept out of the index
+TEST(Dico, memory_budget_sharded)
+{
+  std::vector<std::string_view> words = {"paris", "lyon", "nice", "marseille", "abcdefghijklmnopqrstuvwxyz"};
+  DictionaryOptions opts;
+  opts.backend       = DictionaryBackend::Sharded;
+  opts.memory_budget = 2000;
+  Dictionary t(opts);
+  t.load(words.data(), words.size());
+
+  auto downgraded = t.downgraded_words();
+  ASSERT_NE(std::find(downgraded.begin(), downgraded.end(), "abcdefghijklmnopqrstuvwxyz"), downgraded.end());
+  ASSERT_EQ(t.num_words(), words.size());
+  ASSERT_STREQ(t.best_match("abcdefghijklmnopqrstuvwxy", 1).word, "abcdefghijklmnopqrstuvwxyz");
+  ASSERT_STREQ(t.best_match("pari", 1).word, "paris");
+
+  t.add_word("zyxwvutsrqponmlkjihgfedcba");
+  ASSERT_EQ(t.downgraded_words().size(), downgraded.size() + 1);
+  ASSERT_TRUE(t.has_matches("zyxwvutsrqponmlkjihgfedcb", 1));
+}